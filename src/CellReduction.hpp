@@ -0,0 +1,221 @@
+#ifndef CELL_REDUCTION_HPP
+#define CELL_REDUCTION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "al/math/al_Vec.hpp"
+
+using namespace al;
+
+// gram-schmidt vectors and coefficients of basis, mu[i][j] is the component
+// of basis[i] along orthogonal[j]
+template <int D>
+void gramSchmidt(const std::vector<Vec<D, double>> &basis,
+                 std::vector<Vec<D, double>> &orthogonal,
+                 std::vector<std::vector<double>> &mu) {
+  int n = basis.size();
+  orthogonal.resize(n);
+  mu.assign(n, std::vector<double>(n, 0.0));
+
+  for (int i = 0; i < n; ++i) {
+    orthogonal[i] = basis[i];
+    for (int j = 0; j < i; ++j) {
+      mu[i][j] = basis[i].dot(orthogonal[j]) / orthogonal[j].magSqr();
+      orthogonal[i] -= mu[i][j] * orthogonal[j];
+    }
+  }
+}
+
+// lll reduction with lovasz constant delta. the reduced vectors span the
+// same lattice and are short and nearly orthogonal, so few niggli steps are
+// left for them. the vectors only change by integer combinations, so
+// integer vectors stay integer
+template <int D, typename T>
+void lllReduce(std::vector<Vec<D, T>> &basis, double delta = 0.99) {
+  int n = basis.size();
+  std::vector<Vec<D, double>> b(n);
+  for (int i = 0; i < n; ++i) {
+    b[i] = Vec<D, double>(basis[i]);
+  }
+  std::vector<Vec<D, double>> orthogonal;
+  std::vector<std::vector<double>> mu;
+
+  gramSchmidt(b, orthogonal, mu);
+  int k = 1;
+  while (k < n) {
+    // size reduction against every earlier vector
+    for (int j = k - 1; j >= 0; --j) {
+      double q = std::round(mu[k][j]);
+      if (q != 0.0) {
+        b[k] -= q * b[j];
+        gramSchmidt(b, orthogonal, mu);
+      }
+    }
+
+    double lovasz = (delta - mu[k][k - 1] * mu[k][k - 1]) *
+                    orthogonal[k - 1].magSqr();
+    if (orthogonal[k].magSqr() >= lovasz) {
+      ++k;
+    } else {
+      std::swap(b[k], b[k - 1]);
+      gramSchmidt(b, orthogonal, mu);
+      k = std::max(k - 1, 1);
+    }
+  }
+
+  for (int i = 0; i < n; ++i) {
+    basis[i] = Vec<D, T>(b[i]);
+  }
+}
+
+// reduces a cell of two or three vectors to its niggli form, the unique
+// reduced cell of the lattice: the vectors are as short as possible, sorted
+// by length, and the angles between them are all acute or all obtuse
+// (otherwise right), with the ties broken by the niggli special conditions.
+// three vectors go through the algorithm of krivy and gruber with the
+// tolerances of grosse-kunstleve et al., two through gauss reduction
+inline void niggliReduce(std::vector<Vec3f> &basis) {
+  if (basis.size() == 2) {
+    Vec3d a(basis[0]), b(basis[1]);
+    while (true) {
+      if (b.magSqr() < a.magSqr()) {
+        std::swap(a, b);
+      }
+      // ties at one half are left, rounding them would swing back and forth
+      double mu = a.dot(b) / a.magSqr();
+      if (std::abs(mu) <= 0.5 + 1E-5) {
+        break;
+      }
+      b -= std::round(mu) * a;
+    }
+    if (a.dot(b) > 0.0) {
+      b = -b;
+    }
+    basis[0] = Vec3f(a);
+    basis[1] = Vec3f(b);
+    return;
+  }
+
+  if (basis.size() != 3) {
+    return;
+  }
+
+  Vec3d a(basis[0]), b(basis[1]), c(basis[2]);
+  double epsilon = 1E-5 * (a.magSqr() + b.magSqr() + c.magSqr()) / 3.0;
+  auto sign = [&](double value) {
+    return value > epsilon ? 1 : (value < -epsilon ? -1 : 0);
+  };
+
+  // each step restarts the checks, a reduced cell passes all of them. the
+  // iteration cap only guards against rounding making two steps undo each
+  // other
+  for (int iteration = 0; iteration < 1000; ++iteration) {
+    double A = a.magSqr(), B = b.magSqr(), C = c.magSqr();
+    double xi = 2.0 * b.dot(c), eta = 2.0 * a.dot(c), zeta = 2.0 * a.dot(b);
+
+    if (sign(A - B) > 0 ||
+        (sign(A - B) == 0 && sign(std::abs(xi) - std::abs(eta)) > 0)) {
+      std::swap(a, b);
+      continue;
+    }
+    if (sign(B - C) > 0 ||
+        (sign(B - C) == 0 && sign(std::abs(eta) - std::abs(zeta)) > 0)) {
+      std::swap(b, c);
+      continue;
+    }
+
+    // flipping a vector flips the signs of its two products, so the sign of
+    // their product decides whether all of them can be made positive
+    int s = sign(xi) * sign(eta) * sign(zeta);
+    if (s > 0) {
+      if (sign(zeta) < 0) {
+        b = -b;
+      }
+      if (sign(eta) < 0) {
+        c = -c;
+      }
+    } else {
+      if (sign(zeta) > 0) {
+        b = -b;
+      }
+      if (sign(eta) > 0) {
+        c = -c;
+      }
+      if (sign(2.0 * b.dot(c)) > 0) {
+        // only possible with a zero product, flipping its pair fixes it
+        if (sign(zeta) == 0) {
+          a = -a;
+          c = -c;
+        } else {
+          a = -a;
+          b = -b;
+        }
+      }
+    }
+    xi = 2.0 * b.dot(c);
+    eta = 2.0 * a.dot(c);
+    zeta = 2.0 * a.dot(b);
+
+    if (sign(std::abs(xi) - B) > 0 ||
+        (sign(xi - B) == 0 && sign(2.0 * eta - zeta) < 0) ||
+        (sign(xi + B) == 0 && sign(zeta) < 0)) {
+      c -= (xi > 0.0 ? 1.0 : -1.0) * b;
+      continue;
+    }
+    if (sign(std::abs(eta) - A) > 0 ||
+        (sign(eta - A) == 0 && sign(2.0 * xi - zeta) < 0) ||
+        (sign(eta + A) == 0 && sign(zeta) < 0)) {
+      c -= (eta > 0.0 ? 1.0 : -1.0) * a;
+      continue;
+    }
+    if (sign(std::abs(zeta) - A) > 0 ||
+        (sign(zeta - A) == 0 && sign(2.0 * xi - eta) < 0) ||
+        (sign(zeta + A) == 0 && sign(eta) < 0)) {
+      b -= (zeta > 0.0 ? 1.0 : -1.0) * a;
+      continue;
+    }
+    double sum = xi + eta + zeta + A + B;
+    if (sign(sum) < 0 ||
+        (sign(sum) == 0 && sign(2.0 * (A + eta) + zeta) > 0)) {
+      c += a + b;
+      continue;
+    }
+    break;
+  }
+
+  basis[0] = Vec3f(a);
+  basis[1] = Vec3f(b);
+  basis[2] = Vec3f(c);
+}
+
+// lengths of the cell vectors and the angles between them in degrees. for
+// three vectors the angles are alpha (b, c), beta (a, c) and gamma (a, b),
+// for two only gamma
+inline void cellParameters(const std::vector<Vec3f> &basis,
+                           std::vector<float> &lengths,
+                           std::vector<float> &angles) {
+  static const float degreesPerRadian = 57.2957795f;
+  auto angle = [](const Vec3f &a, const Vec3f &b) {
+    float cosine = a.dot(b) / (a.mag() * b.mag());
+    return std::acos(std::max(-1.f, std::min(1.f, cosine))) * degreesPerRadian;
+  };
+
+  lengths.clear();
+  angles.clear();
+  for (auto &v : basis) {
+    lengths.push_back(v.mag());
+  }
+
+  if (basis.size() == 2) {
+    angles.push_back(angle(basis[0], basis[1]));
+  } else if (basis.size() == 3) {
+    angles.push_back(angle(basis[1], basis[2]));
+    angles.push_back(angle(basis[0], basis[2]));
+    angles.push_back(angle(basis[0], basis[1]));
+  }
+}
+
+#endif // CELL_REDUCTION_HPP
\ No newline at end of file
@@ -14,8 +14,13 @@
 #include "al/math/al_Vec.hpp"
 #include "al/ui/al_ParameterGUI.hpp"
 
+#include "Dimensions.hpp"
 #include "Lattice.hpp"
+#include "LatticeVecParameter.hpp"
+#include "Pathway.hpp"
+#include "ResultCache.hpp"
 #include "Slice.hpp"
+#include "Timing.hpp"
 
 class CrystalViewer {
 public:
@@ -45,6 +50,17 @@ public:
     sliceColors.usage(GL_DYNAMIC_DRAW);
     sliceColors.create();
 
+    addWireBox(nodeBox, pickRadius);
+    nodeBox.update();
+
+    boxPositions.bufferType(GL_ARRAY_BUFFER);
+    boxPositions.usage(GL_DYNAMIC_DRAW);
+    boxPositions.create();
+
+    boxColors.bufferType(GL_ARRAY_BUFFER);
+    boxColors.usage(GL_DYNAMIC_DRAW);
+    boxColors.create();
+
     auto &latticeVAO = latticeSphere.vao();
     latticeVAO.bind();
     latticeVAO.enableAttrib(1);
@@ -65,6 +81,16 @@ public:
     sliceVAO.attribPointer(2, sliceColors, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glVertexAttribDivisor(2, 1);
 
+    auto &boxVAO = nodeBox.vao();
+    boxVAO.bind();
+    boxVAO.enableAttrib(1);
+    boxVAO.attribPointer(1, boxPositions, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribDivisor(1, 1);
+
+    boxVAO.enableAttrib(2);
+    boxVAO.attribPointer(2, boxColors, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribDivisor(2, 1);
+
     latticeEdge.vertex(Vec3f(0));
     latticeEdge.vertex(Vec3f(1, 1, 1));
     latticeEdge.update();
@@ -128,59 +154,60 @@ public:
                "edge_instancing_frag.glsl", "edge_instancing_geom.glsl");
   }
 
+  // the templates for every supported pair of dimensions are generated by
+  // dispatchDimensions
   void createCrystal(int newDim, int newSliceDim) {
-    switch (newDim) {
-    case 3: {
-      auto newLattice = std::make_shared<Lattice<3>>(lattice);
-      auto newSlice = std::make_shared<Slice<3, 2>>(slice, newLattice);
-
+    bool supported = dispatchDimensions(newDim, newSliceDim, [&](auto dims) {
+      typedef decltype(dims) D;
+      auto newLattice = std::make_shared<Lattice<D::latticeDim>>(lattice);
+      slice = std::make_shared<Slice<D::latticeDim, D::sliceDim>>(slice,
+                                                                 newLattice);
       lattice = newLattice;
       lattice->latticeSize = latticeSize.get();
-      slice = newSlice;
-      break;
-    }
-    case 4: {
-      auto newLattice = std::make_shared<Lattice<4>>(lattice);
-      if (newSliceDim == 2) {
-        auto newSlice = std::make_shared<Slice<4, 2>>(slice, newLattice);
-        slice = newSlice;
-      } else if (newSliceDim == 3) {
-        auto newSlice = std::make_shared<Slice<4, 3>>(slice, newLattice);
-        slice = newSlice;
-      }
-      lattice = newLattice;
-      lattice->latticeSize = latticeSize.get();
-      break;
-    }
-    case 5: {
-      auto newLattice = std::make_shared<Lattice<5>>(lattice);
-      if (newSliceDim == 2) {
-        auto newSlice = std::make_shared<Slice<5, 2>>(slice, newLattice);
-        slice = newSlice;
-      } else if (newSliceDim == 3) {
-        auto newSlice = std::make_shared<Slice<5, 3>>(slice, newLattice);
-        slice = newSlice;
-      }
-      lattice = newLattice;
-      lattice->latticeSize = latticeSize.get();
-      break;
-    }
-    default:
-      std::cerr << "Dimension " << newDim << " not supported." << std::endl;
+    });
+
+    if (!supported) {
+      std::cerr << "Dimension " << newDim << ":" << newSliceDim
+                << " not supported." << std::endl;
       return;
     }
+
+    // the cache outlives the slices, so returning to earlier dimensions or
+    // parameters only costs an upload
+    slice->resultCache = resultCache;
   }
 
   void draw(Graphics &g, Nav &nav) {
+    frameTimes.frame();
 
     if (needsCreate) {
+      // the frames of a pathway are computed for the old dimensions
+      if (pathwayPlayer.playing()) {
+        pathwayPlayer.stop();
+        playPathway.setNoCalls(0.f);
+      }
       createCrystal(crystalDim.get(), sliceDim.get());
       needsCreate = false;
     }
 
+    if (shouldTogglePathway) {
+      if (playPathway.get()) {
+        if (!pathwayPlayer.start(pathway, slice, latticeSize.get())) {
+          playPathway.setNoCalls(0.f);
+        }
+      } else {
+        pathwayPlayer.stop();
+        slice->showFrame(nullptr);
+      }
+      shouldTogglePathway = false;
+    }
+
     lattice->pollUpdate();     // update if needs update
     if (slice->pollUpdate()) { // update if needs update
+      sliceStats = slice->getStats();
+      publishSliceStats();
       updateSliceBasis();
+      updateLatticeProjection();
       slice->updateNodeInfo(nodeInfo);
       slice->updateUnitCellInfo(unitCellInfo, cornerNodes);
       if (!loadUnitCell) {
@@ -191,6 +218,10 @@ public:
       }
     }
 
+    if (pathwayPlayer.playing()) {
+      slice->showFrame(pathwayPlayer.advance(frameTimes.lastMs / 1000.f));
+    }
+
     if (loadUnitCell) {
       slice->loadUnitCell(cornerNode0.get(), cornerNode1.get(),
                           cornerNode2.get(), cornerNode3.get());
@@ -203,10 +234,20 @@ public:
       showInfo = true;
     }
 
+    // the unit cell info is updated with the result the worker publishes
+    if (shouldFindUnitCell) {
+      slice->findUnitCell();
+      shouldFindUnitCell = false;
+      showInfo = true;
+    }
+
     g.depthTesting(false);
     g.blending(true);
     g.blendAdd();
 
+    slice->uploadedBytes = 0;
+    slice->uploadMs = 0.f;
+
     g.pushMatrix();
 
     if (showLattice.get()) {
@@ -219,9 +260,80 @@ public:
       drawSlice(g);
     }
 
-    slice->drawPickables(g);
+    drawBoxes(g);
+    slice->drawUnitCell(g);
 
     g.popMatrix();
+
+    sliceUploadBytes = slice->uploadedBytes;
+    sliceUploadMs = slice->uploadMs;
+
+    if (restorePerformance) {
+      restorePerformance = false;
+      publishSliceStats();
+      publishFrameStats();
+    } else if (floor(al_system_time()) > frameStatsTime) {
+      frameStatsTime = floor(al_system_time());
+      publishFrameStats();
+    }
+  }
+
+  // the performance parameters are only written here, a remote write is
+  // undone on the next frame, see registerPerformanceCallbacks
+  void publishSliceStats() {
+    publishingStats = true;
+    for (unsigned int i = 0; i < stageNum; ++i) {
+      stageParameters[i]->set(sliceStats.stageMs[i]);
+    }
+    sliceCandidates.set(sliceStats.candidates);
+    sliceNodes.set(sliceStats.nodes);
+    slicePairs.set(sliceStats.pairs);
+    sliceEdges.set(sliceStats.edges);
+    sliceEnvironments.set(sliceStats.environments);
+    publishingStats = false;
+  }
+
+  void publishFrameStats() {
+    publishingStats = true;
+    frameP50Ms.set(frameTimes.percentile(50.f));
+    frameP95Ms.set(frameTimes.percentile(95.f));
+    frameP99Ms.set(frameTimes.percentile(99.f));
+    uploadMs.set(sliceUploadMs);
+
+    ResultCache::Stats cacheStats = resultCache->getStats();
+    cacheHits.set(cacheStats.hits);
+    cacheMisses.set(cacheStats.misses);
+    cacheEntries.set(cacheStats.entries);
+    cacheMB.set(cacheStats.bytes / 1E6);
+    publishingStats = false;
+  }
+
+  // the performance parameters are outputs, any value not set by the publish
+  // functions is replaced with the measurement again
+  void registerPerformanceCallbacks() {
+    auto restoreFloat = [&](float value) {
+      if (!publishingStats) {
+        restorePerformance = true;
+      }
+    };
+    auto restoreInt = [&](int value) {
+      if (!publishingStats) {
+        restorePerformance = true;
+      }
+    };
+
+    for (auto *parameter : stageParameters) {
+      parameter->registerChangeCallback(restoreFloat);
+    }
+    for (auto *parameter : {&uploadMs, &frameP50Ms, &frameP95Ms, &frameP99Ms,
+                            &cacheMB}) {
+      parameter->registerChangeCallback(restoreFloat);
+    }
+    for (auto *parameter : {&sliceCandidates, &sliceNodes, &slicePairs,
+                            &sliceEdges, &sliceEnvironments, &cacheHits,
+                            &cacheMisses, &cacheEntries}) {
+      parameter->registerChangeCallback(restoreInt);
+    }
   }
 
   void drawLattice(Graphics &g) {
@@ -274,6 +386,21 @@ public:
                           slice->getEdgeNum());
   }
 
+  // boxes around hovered, selected and unit cell corner nodes, or around all
+  // nodes, in one instanced draw
+  void drawBoxes(Graphics &g) {
+    slice->uploadBoxes(boxPositions, boxColors, showAllBoxes.get());
+
+    g.shader(instancing_shader);
+    instancing_shader.uniform("scale", 1.f);
+    g.update();
+
+    nodeBox.vao().bind();
+    nodeBox.indexBuffer().bind();
+    glDrawElementsInstanced(GL_LINES, nodeBox.indices().size(),
+                            GL_UNSIGNED_INT, 0, slice->getBoxNum());
+  }
+
   void updatePickables(bool modifyUnitCell) {
     if (slice->updatePickables(nodeInfo, modifyUnitCell)) {
       slice->updateUnitCellInfo(unitCellInfo, cornerNodes);
@@ -284,83 +411,54 @@ public:
     }
   }
 
-  void setBasis(Vec5f &value, int basisNum) {
+  void setBasis(const LatticeVec &value, int basisNum) {
     lattice->setBasis(value, basisNum);
     slice->needsUpdate = true;
   }
 
+  // the parameters past the slice's dimensions are hidden and keep their
+  // values
   void updateSliceBasis() {
-    // TODO: remove dimension check
-    miller0.setNoCalls(slice->getMiller(0));
-    miller1.setNoCalls(slice->getMiller(1));
-    miller2.setNoCalls(slice->getMiller(2));
-    hyperplane0.setNoCalls(slice->getNormal(0));
-    hyperplane1.setNoCalls(slice->getNormal(1));
-    hyperplane2.setNoCalls(slice->getNormal(2));
-    sliceBasis0.setNoCalls(slice->getSliceBasis(0));
-    sliceBasis1.setNoCalls(slice->getSliceBasis(1));
-    sliceBasis2.setNoCalls(slice->getSliceBasis(2));
-    sliceBasis3.setNoCalls(slice->getSliceBasis(3));
+    for (int i = 0; i < slice->latticeDim - slice->sliceDim; ++i) {
+      miller[i]->setNoCalls(slice->getMiller(i));
+      hyperplane[i]->setNoCalls(slice->getNormal(i));
+    }
+    for (int i = 0; i < slice->sliceDim; ++i) {
+      sliceBasis[i]->setNoCalls(slice->getSliceBasis(i));
+    }
   }
 
-  void setDimensionHints(float value) {
-    basis0.setHint("dimension", value);
-    basis1.setHint("dimension", value);
-    basis2.setHint("dimension", value);
-    basis3.setHint("dimension", value);
-    basis4.setHint("dimension", value);
-    miller0.setHint("dimension", value);
-    miller1.setHint("dimension", value);
-    miller2.setHint("dimension", value);
-    hyperplane0.setHint("dimension", value);
-    hyperplane1.setHint("dimension", value);
-    hyperplane2.setHint("dimension", value);
-    sliceBasis0.setHint("dimension", value);
-    sliceBasis1.setHint("dimension", value);
-    sliceBasis2.setHint("dimension", value);
-    sliceBasis3.setHint("dimension", value);
+  // draws the unit cell projected onto the slice, as the slice points are
+  void updateLatticeProjection() {
+    std::array<LatticeVec, 3> rows;
+    for (int i = 0; i < 3; ++i) {
+      rows[i] = i < slice->sliceDim ? slice->getSliceBasis(i) : LatticeVec(0.f);
+    }
+    lattice->setProjection(rows);
   }
 
-  void setHideHints(int crystal_dim, int slice_dim) {
-    if (crystal_dim > 3) {
-      basis3.removeHint("hide");
-      if (crystal_dim > 4) {
-        basis4.removeHint("hide");
-      } else {
-        basis4.setHint("hide", 1.f);
+  void setDimensionHints(int value) {
+    for (auto *parameters : {&basis, &miller, &hyperplane, &sliceBasis}) {
+      for (auto &parameter : *parameters) {
+        parameter->setDimension(value);
       }
-    } else {
-      basis3.setHint("hide", 1.f);
-      basis4.setHint("hide", 1.f);
+    }
+  }
+
+  void setHideHints(int crystal_dim, int slice_dim) {
+    for (int i = 0; i < basis.size(); ++i) {
+      basis[i]->setHidden(i >= crystal_dim);
     }
 
-    if (slice_dim > 2) {
-      sliceBasis2.removeHint("hide");
-      if (slice_dim > 3) {
-        sliceBasis3.removeHint("hide");
-      } else {
-        sliceBasis3.setHint("hide", 1.f);
-      }
-    } else {
-      sliceBasis2.setHint("hide", 1.f);
-      sliceBasis3.setHint("hide", 1.f);
+    for (int i = 0; i < sliceBasis.size(); ++i) {
+      sliceBasis[i]->setHidden(i >= slice_dim);
     }
 
-    if (crystal_dim - slice_dim > 1) {
-      miller1.removeHint("hide");
-      hyperplane1.removeHint("hide");
-      if (crystal_dim - slice_dim > 2) {
-        miller2.removeHint("hide");
-        hyperplane2.removeHint("hide");
-      } else {
-        miller2.setHint("hide", 1.f);
-        hyperplane2.setHint("hide", 1.f);
-      }
-    } else {
-      miller1.setHint("hide", 1.f);
-      miller2.setHint("hide", 1.f);
-      hyperplane1.setHint("hide", 1.f);
-      hyperplane2.setHint("hide", 1.f);
+    sliceOffset.setDimension(crystal_dim - slice_dim);
+
+    for (int i = 0; i < miller.size(); ++i) {
+      miller[i]->setHidden(i >= crystal_dim - slice_dim);
+      hyperplane[i]->setHidden(i >= crystal_dim - slice_dim);
     }
   }
 
@@ -392,12 +490,13 @@ public:
     setHideHints(crystalDim.getDefault(), sliceDim.getDefault());
 
     crystalDim.registerChangeCallback([&](int value) {
-      sliceDim.max(value - 1);
-      if (sliceDim.get() > value - 1) {
-        sliceDim.set(value - 1);
+      int maxDim = std::min(value - 1, maxSliceDim);
+      sliceDim.max(maxDim);
+      if (sliceDim.get() > maxDim) {
+        sliceDim.set(maxDim);
       }
 
-      setDimensionHints((float)value);
+      setDimensionHints(value);
       setHideHints(value, sliceDim.get());
 
       needsCreate = true;
@@ -409,28 +508,24 @@ public:
       needsCreate = true;
     });
 
+    resultCacheMB.registerChangeCallback(
+        [&](int value) { resultCache->setBudget(size_t(value) * 1000000); });
+
     latticeSize.registerChangeCallback([&](int value) {
       lattice->latticeSize = value;
       lattice->needsUpdate = true;
       slice->needsUpdate = true;
     });
 
-    basis0.registerChangeCallback([&](Vec5f value) { setBasis(value, 0); });
-
-    basis1.registerChangeCallback([&](Vec5f value) { setBasis(value, 1); });
-
-    basis2.registerChangeCallback([&](Vec5f value) { setBasis(value, 2); });
-
-    basis3.registerChangeCallback([&](Vec5f value) { setBasis(value, 3); });
-
-    basis4.registerChangeCallback([&](Vec5f value) { setBasis(value, 4); });
+    for (int i = 0; i < basis.size(); ++i) {
+      basis[i]->registerChangeCallback(
+          [&, i](LatticeVec value) { setBasis(value, i); });
+    }
 
     resetBasis.registerChangeCallback([&](bool value) {
-      basis0.setNoCalls(basis0.getDefault());
-      basis1.setNoCalls(basis1.getDefault());
-      basis2.setNoCalls(basis2.getDefault());
-      basis3.setNoCalls(basis3.getDefault());
-      basis4.setNoCalls(basis4.getDefault());
+      for (auto &parameter : basis) {
+        parameter->setNoCalls(parameter->getDefault());
+      }
       lattice->resetBasis();
 
       slice->needsUpdate = true;
@@ -439,49 +534,46 @@ public:
     sliceDepth.registerChangeCallback(
         [&](float value) { slice->setDepth(value); });
 
+    sliceOffset.registerChangeCallback(
+        [&](LatticeVec value) { slice->setOffset(value); });
+
     edgeThreshold.registerChangeCallback(
         [&](float value) { slice->setThreshold(value); });
 
+    acceptanceWindow.setElements(
+        std::vector<std::string>(windowNames.begin(), windowNames.end()));
+    acceptanceWindow.registerChangeCallback(
+        [&](int value) { slice->setWindow(AcceptanceWindow(value)); });
+
     intMiller.registerChangeCallback([&](float value) {
       if (value) {
-        miller0.setHint("format", 0);
-        miller1.setHint("format", 0);
-        miller2.setHint("format", 0);
+        for (auto &parameter : miller) {
+          parameter->setHint("format", 0);
+        }
 
         slice->roundMiller();
 
-        miller0.setNoCalls(slice->getMiller(0));
-        miller1.setNoCalls(slice->getMiller(1));
-        miller2.setNoCalls(slice->getMiller(2));
+        for (int i = 0; i < slice->latticeDim - slice->sliceDim; ++i) {
+          miller[i]->setNoCalls(slice->getMiller(i));
+        }
       } else {
-        miller0.removeHint("format");
-        miller1.removeHint("format");
-        miller2.removeHint("format");
+        for (auto &parameter : miller) {
+          parameter->removeHint("format");
+        }
       }
     });
 
-    miller0.registerChangeCallback(
-        [&](Vec5f value) { slice->setMiller(value, 0); });
-    miller1.registerChangeCallback(
-        [&](Vec5f value) { slice->setMiller(value, 1); });
-    miller2.registerChangeCallback(
-        [&](Vec5f value) { slice->setMiller(value, 2); });
-
-    hyperplane0.registerChangeCallback(
-        [&](Vec5f value) { slice->setNormal(value, 0); });
-    hyperplane1.registerChangeCallback(
-        [&](Vec5f value) { slice->setNormal(value, 1); });
-    hyperplane2.registerChangeCallback(
-        [&](Vec5f value) { slice->setNormal(value, 2); });
-
-    sliceBasis0.registerChangeCallback(
-        [&](Vec5f value) { slice->setSliceBasis(value, 0); });
-    sliceBasis1.registerChangeCallback(
-        [&](Vec5f value) { slice->setSliceBasis(value, 1); });
-    sliceBasis2.registerChangeCallback(
-        [&](Vec5f value) { slice->setSliceBasis(value, 2); });
-    sliceBasis3.registerChangeCallback(
-        [&](Vec5f value) { slice->setSliceBasis(value, 3); });
+    for (int i = 0; i < miller.size(); ++i) {
+      miller[i]->registerChangeCallback(
+          [&, i](LatticeVec value) { slice->setMiller(value, i); });
+      hyperplane[i]->registerChangeCallback(
+          [&, i](LatticeVec value) { slice->setNormal(value, i); });
+    }
+
+    for (int i = 0; i < sliceBasis.size(); ++i) {
+      sliceBasis[i]->registerChangeCallback(
+          [&, i](LatticeVec value) { slice->setSliceBasis(value, i); });
+    }
 
     cornerNode0.registerChangeCallback([&](int value) { loadUnitCell = true; });
     cornerNode1.registerChangeCallback([&](int value) { loadUnitCell = true; });
@@ -492,6 +584,11 @@ public:
     resetUnitCell.registerChangeCallback(
         {[&](bool value) { slice->resetUnitCell(); }});
 
+    findUnitCell.registerChangeCallback(
+        [&](bool value) { shouldFindUnitCell = true; });
+
+    registerPerformanceCallbacks();
+
     exportTxt.registerChangeCallback([&](bool value) {
       std::string newPath = File::conformPathToOS(dataDir + fileName);
       slice->exportToTxt(newPath);
@@ -511,24 +608,75 @@ public:
       std::cout << "after loading" << std::endl;
     });
 
+    addKeyframe.registerChangeCallback([&](bool value) {
+      PathwayKeyframe keyframe;
+      keyframe.time = keyframeTime.get();
+      for (unsigned int i = 0; i < keyframe.basis.size(); ++i) {
+        keyframe.basis[i] = basis[i]->get();
+      }
+      for (unsigned int i = 0; i < keyframe.miller.size(); ++i) {
+        keyframe.miller[i] = miller[i]->get();
+      }
+      keyframe.sliceDepth = sliceDepth.get();
+      pathway.addKeyframe(keyframe);
+
+      // the next keyframe defaults to one second later
+      keyframeTime.setNoCalls(keyframeTime.get() + 1.f);
+    });
+
+    clearPathway.registerChangeCallback([&](bool value) {
+      pathway.keyframes.clear();
+      keyframeTime.setNoCalls(0.f);
+      playPathway.set(0.f);
+    });
+
+    playPathway.registerChangeCallback(
+        [&](float value) { shouldTogglePathway = true; });
+
     openInfo.registerChangeCallback([&](float value) { showInfo = !showInfo; });
 
-    parameterServer << crystalDim << sliceDim << latticeSize << basis0 << basis1
-                    << basis2 << basis3 << basis4 << resetBasis << showLattice
-                    << showSlice << sphereSize << edgeColor << sliceDepth
-                    << edgeThreshold << intMiller << miller0 << miller1
-                    << miller2 << hyperplane0 << hyperplane1 << hyperplane2
-                    << sliceBasis0 << sliceBasis1 << sliceBasis2 << sliceBasis3
-                    << cornerNode0 << cornerNode1 << cornerNode2 << cornerNode3
-                    << resetUnitCell;
+    openPerformance.registerChangeCallback(
+        [&](float value) { showPerformance = !showPerformance; });
+
+    parameterServer << crystalDim << sliceDim << latticeSize;
+    for (auto &parameter : basis) {
+      parameterServer << parameter->low << parameter->high;
+    }
+    parameterServer << resetBasis << showLattice << showSlice << showAllBoxes
+                    << sphereSize << edgeColor << sliceDepth << sliceOffset.low
+                    << sliceOffset.high << edgeThreshold << acceptanceWindow
+                    << intMiller;
+    for (auto *parameters : {&miller, &hyperplane, &sliceBasis}) {
+      for (auto &parameter : *parameters) {
+        parameterServer << parameter->low << parameter->high;
+      }
+    }
+    parameterServer << cornerNode0 << cornerNode1 << cornerNode2 << cornerNode3
+                    << resetUnitCell << findUnitCell;
+    parameterServer << keyframeTime << addKeyframe << clearPathway
+                    << playPathway;
+
+    // read by remote monitors, not part of the presets
+    for (auto *parameter : stageParameters) {
+      parameterServer << *parameter;
+    }
+    parameterServer << sliceCandidates << sliceNodes << slicePairs
+                    << sliceEdges << sliceEnvironments << uploadMs
+                    << frameP50Ms << frameP95Ms << frameP99Ms << cacheHits
+                    << cacheMisses << cacheEntries << cacheMB;
+    parameterServer << resultCacheMB;
 
     // TODO: update apparently happens multiple times on load
     presets << crystalDim << sliceDim << latticeSize << showLattice << showSlice
-            << sphereSize << edgeColor << sliceDepth << edgeThreshold
-            << intMiller << miller0 << miller1 << miller2 << hyperplane0
-            << hyperplane1 << hyperplane2 << sliceBasis0 << sliceBasis1
-            << sliceBasis2 << sliceBasis3 << cornerNode0 << cornerNode1
-            << cornerNode2 << cornerNode3;
+            << showAllBoxes << sphereSize << edgeColor << sliceDepth
+            << sliceOffset.low << sliceOffset.high << edgeThreshold
+            << acceptanceWindow << intMiller;
+    for (auto *parameters : {&miller, &hyperplane, &sliceBasis}) {
+      for (auto &parameter : *parameters) {
+        presets << parameter->low << parameter->high;
+      }
+    }
+    presets << cornerNode0 << cornerNode1 << cornerNode2 << cornerNode3;
 
     return true;
   }
@@ -562,11 +710,9 @@ public:
         // ParameterGUI::draw(&basisNum);
         // ImGui::PopStyleColor(4);
         ImGui::Indent();
-        ParameterGUI::draw(&basis0);
-        ParameterGUI::draw(&basis1);
-        ParameterGUI::draw(&basis2);
-        ParameterGUI::draw(&basis3);
-        ParameterGUI::draw(&basis4);
+        for (auto &parameter : basis) {
+          parameter->draw();
+        }
         ParameterGUI::draw(&resetBasis);
         ImGui::Unindent();
       }
@@ -576,18 +722,23 @@ public:
       ParameterGUI::draw(&showSlice);
       ImGui::SameLine(0, 20);
       ParameterGUI::draw(&openInfo);
+      ImGui::SameLine();
+      ParameterGUI::draw(&openPerformance);
 
       if (ImGui::CollapsingHeader("Edit Display Settings",
                                   ImGuiTreeNodeFlags_CollapsingHeader)) {
         ParameterGUI::draw(&sphereSize);
         ParameterGUI::draw(&edgeColor);
+        ParameterGUI::draw(&showAllBoxes);
       }
 
       ImGui::NewLine();
 
       if (showSlice.get()) {
         ParameterGUI::draw(&sliceDepth);
+        sliceOffset.draw();
         ParameterGUI::draw(&edgeThreshold);
+        ParameterGUI::draw(&acceptanceWindow);
 
         ImGui::NewLine();
       }
@@ -608,32 +759,55 @@ public:
 
         ParameterGUI::draw(&intMiller);
         ImGui::Indent();
-        ParameterGUI::draw(&miller0);
-        ParameterGUI::draw(&miller1);
-        ParameterGUI::draw(&miller2);
+        for (auto &parameter : miller) {
+          parameter->draw();
+        }
         ImGui::Unindent();
       }
 
       if (ImGui::CollapsingHeader("Edit Hyperplane Normals",
                                   ImGuiTreeNodeFlags_CollapsingHeader)) {
         ImGui::Indent();
-        ParameterGUI::draw(&hyperplane0);
-        ParameterGUI::draw(&hyperplane1);
-        ParameterGUI::draw(&hyperplane2);
+        for (auto &parameter : hyperplane) {
+          parameter->draw();
+        }
         ImGui::Unindent();
       }
 
       if (ImGui::CollapsingHeader("Edit Slice Basis",
                                   ImGuiTreeNodeFlags_CollapsingHeader)) {
         ImGui::Indent();
-        ParameterGUI::draw(&sliceBasis0);
-        ParameterGUI::draw(&sliceBasis1);
-        ParameterGUI::draw(&sliceBasis2);
-        ParameterGUI::draw(&sliceBasis3);
+        for (auto &parameter : sliceBasis) {
+          parameter->draw();
+        }
         ImGui::Unindent();
       }
 
       ParameterGUI::draw(&resetUnitCell);
+      ImGui::SameLine();
+      ParameterGUI::draw(&findUnitCell);
+
+      if (ImGui::CollapsingHeader("Pathway",
+                                  ImGuiTreeNodeFlags_CollapsingHeader)) {
+        ImGui::Indent();
+        ParameterGUI::draw(&keyframeTime);
+        ParameterGUI::draw(&addKeyframe);
+        ImGui::SameLine();
+        ParameterGUI::draw(&clearPathway);
+        ImGui::SameLine();
+        ParameterGUI::draw(&playPathway);
+        ImGui::Text("%zu keyframes, %.2f s", pathway.keyframes.size(),
+                    pathway.duration());
+        if (pathwayPlayer.playing()) {
+          unsigned int frameCount;
+          size_t bytes;
+          pathwayPlayer.cacheStats(frameCount, bytes);
+          ImGui::Text("Playing %.2f / %.2f s, %u frames ahead (%.1f MB)",
+                      pathwayPlayer.time(), pathwayPlayer.duration(),
+                      frameCount, bytes / 1E6);
+        }
+        ImGui::Unindent();
+      }
 
       ImGui::NewLine();
 
@@ -702,6 +876,41 @@ public:
 
       ImGui::End();
     }
+
+    if (showPerformance) {
+      if (ImGui::Begin("Performance", &showPerformance)) {
+        ImGui::Text("Last slice update: %.2f ms", sliceStats.totalMs());
+        ImGui::Indent();
+        for (unsigned int i = 0; i < stageNum; ++i) {
+          ImGui::Text("%s: %.2f ms", stageNames[i], sliceStats.stageMs[i]);
+        }
+        ImGui::Unindent();
+
+        ImGui::Text("candidates: %u", sliceStats.candidates);
+        ImGui::Text("nodes: %u", sliceStats.nodes);
+        ImGui::Text("node pairs: %u", sliceStats.pairs);
+        ImGui::Text("edges: %u", sliceStats.edges);
+        ImGui::Text("environments: %u", sliceStats.environments);
+
+        ImGui::NewLine();
+        ImGui::Text("Frame: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms",
+                    frameTimes.percentile(50.f), frameTimes.percentile(95.f),
+                    frameTimes.percentile(99.f));
+        ImGui::Text("Slice upload: %zu bytes, %.2f ms per frame",
+                    sliceUploadBytes, sliceUploadMs);
+
+        ImGui::NewLine();
+        ParameterGUI::draw(&resultCacheMB);
+        ResultCache::Stats cacheStats = resultCache->getStats();
+        ImGui::Text("Result cache: %llu hits, %llu misses, %zu entries "
+                    "(%.1f MB)",
+                    (unsigned long long)cacheStats.hits,
+                    (unsigned long long)cacheStats.misses, cacheStats.entries,
+                    cacheStats.bytes / 1E6);
+      }
+
+      ImGui::End();
+    }
   }
 
   void watchFile(std::string path) {
@@ -774,50 +983,57 @@ private:
 
   ShaderProgram instancing_shader, edge_instancing_shader;
 
-  VAOMesh latticeSphere, latticeEdge, sliceSphere, sliceEdge;
+  VAOMesh latticeSphere, latticeEdge, sliceSphere, sliceEdge, nodeBox;
   BufferObject latticeVertices, latticeColors, latticeEdgeStarts,
       latticeEdgeEnds;
   BufferObject sliceVertices, sliceColors, sliceEdgeStarts, sliceEdgeEnds;
+  BufferObject boxPositions, boxColors;
 
   PresetHandler presets{"data/presets", true};
 
   bool needsCreate{false};
   bool loadUnitCell{false};
-
-  ParameterInt crystalDim{"crystalDim", "", 3, 3, 5};
+  bool shouldFindUnitCell{false};
+  bool shouldTogglePathway{false};
+  size_t sliceUploadBytes{0};
+  float sliceUploadMs{0.f};
+
+  FrameTimes frameTimes;
+  al_sec frameStatsTime{0};
+  bool publishingStats{false};
+  bool restorePerformance{false};
+  SliceStats sliceStats;
+
+  ParameterInt crystalDim{"crystalDim", "", 3, minLatticeDim, maxLatticeDim};
   ParameterInt sliceDim{"sliceDim", "", 2, 2, 2};
-  ParameterInt latticeSize{"latticeSize", "", 1, 1, 15};
+  ParameterInt latticeSize{"latticeSize", "", 1, 1, 64};
 
   // TODO: add min/max control?
-  ParameterVec5 basis0{"basis0", "", Vec5f(1.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 basis1{"basis1", "", Vec5f(0.f, 1.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 basis2{"basis2", "", Vec5f(0.f, 0.f, 1.f, 0.f, 0.f)};
-  ParameterVec5 basis3{"basis3", "", Vec5f(0.f, 0.f, 0.f, 1.f, 0.f)};
-  ParameterVec5 basis4{"basis4", "", Vec5f(0.f, 0.f, 0.f, 0.f, 1.f)};
+  LatticeVecParameters basis{
+      makeLatticeVecParameters("basis", maxLatticeDim, true)};
   Trigger resetBasis{"resetBasis", ""};
 
   ParameterBool showLattice{"showLattice", "", 0};
   ParameterBool showSlice{"showSlice", "", 1};
+  ParameterBool showAllBoxes{"showAllBoxes", "", 0};
 
   Parameter sphereSize{"sphereSize", "", 0.04, 0.001, 1};
   ParameterColor edgeColor{"edgeColor", "", Color(1.f, 0.3f)};
 
   Parameter sliceDepth{"sliceDepth", "", 1.0f, 0, 1000.f};
+  LatticeVecParameter sliceOffset{"sliceOffset", LatticeVec(0.f)};
   Parameter edgeThreshold{"edgeThreshold", "", 1.1f, 0.f, 2.f};
+  ParameterMenu acceptanceWindow{"acceptanceWindow", "", 0};
 
   ParameterBool intMiller{"intMiller", ""};
-  ParameterVec5 miller0{"miller0", "", Vec5f(1.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 miller1{"miller1", "", Vec5f(0.f, 1.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 miller2{"miller2", "", Vec5f(0.f, 0.f, 1.f, 0.f, 0.f)};
-
-  ParameterVec5 hyperplane0{"hyperplane0", "", Vec5f(1.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 hyperplane1{"hyperplane1", "", Vec5f(0.f, 1.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 hyperplane2{"hyperplane2", "", Vec5f(0.f, 0.f, 1.f, 0.f, 0.f)};
-
-  ParameterVec5 sliceBasis0{"sliceBasis0", "", Vec5f(0.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 sliceBasis1{"sliceBasis1", "", Vec5f(0.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 sliceBasis2{"sliceBasis2", "", Vec5f(0.f, 0.f, 0.f, 0.f, 0.f)};
-  ParameterVec5 sliceBasis3{"sliceBasis3", "", Vec5f(0.f, 0.f, 0.f, 0.f, 0.f)};
+  // one miller index and hyperplane normal per slice normal, at most
+  // maxLatticeDim - minSliceDim of them
+  LatticeVecParameters miller{
+      makeLatticeVecParameters("miller", maxLatticeDim - minSliceDim, true)};
+  LatticeVecParameters hyperplane{makeLatticeVecParameters(
+      "hyperplane", maxLatticeDim - minSliceDim, true)};
+  LatticeVecParameters sliceBasis{
+      makeLatticeVecParameters("sliceBasis", maxSliceDim, false)};
 
   ParameterInt cornerNode0{"cornerNode0", "", -1, -1, INT32_MAX};
   ParameterInt cornerNode1{"cornerNode1", "", -1, -1, INT32_MAX};
@@ -826,6 +1042,20 @@ private:
   Vec4i cornerNodes{-1, -1, -1, -1};
 
   Trigger resetUnitCell{"resetUnitCell", ""};
+  Trigger findUnitCell{"findUnitCell", ""};
+
+  // keyframes are added from the current basis, miller indices and depth
+  Pathway pathway;
+  PathwayPlayer pathwayPlayer;
+  Parameter keyframeTime{"keyframeTime", "", 0.f, 0.f, 600.f};
+  Trigger addKeyframe{"addKeyframe", ""};
+  Trigger clearPathway{"clearPathway", ""};
+  ParameterBool playPathway{"playPathway", "", 0};
+
+  // full slice results by their parameters, kept across createCrystal
+  ParameterInt resultCacheMB{"resultCacheMB", "", 512, 0, 65536};
+  std::shared_ptr<ResultCache> resultCache{
+      std::make_shared<ResultCache>(size_t(512) * 1000000)};
 
   std::string dataDir;
   char filePath[128]{};
@@ -841,6 +1071,39 @@ private:
   bool showInfo{false};
   std::array<std::string, 4> nodeInfo;
   std::array<std::string, 5> unitCellInfo;
+
+  Trigger openPerformance{"openPerformance", ""};
+  bool showPerformance{false};
+
+  // measurements published over the parameter server, read-only, see
+  // registerPerformanceCallbacks
+  Parameter normalsMs{"computeNormalsMs", "performance", 0.f, 0.f, 1E6};
+  Parameter enumerationMs{"enumerationMs", "performance", 0.f, 0.f, 1E6};
+  Parameter overlapMs{"overlapScanMs", "performance", 0.f, 0.f, 1E6};
+  Parameter updateNodesMs{"updateNodesMs", "performance", 0.f, 0.f, 1E6};
+  Parameter environmentsMs{"environmentsMs", "performance", 0.f, 0.f, 1E6};
+  Parameter renderDataMs{"renderDataMs", "performance", 0.f, 0.f, 1E6};
+  Parameter pickHashMs{"pickHashMs", "performance", 0.f, 0.f, 1E6};
+  Parameter resultCacheMs{"resultCacheMs", "performance", 0.f, 0.f, 1E6};
+  std::array<Parameter *, stageNum> stageParameters{
+      {&normalsMs, &enumerationMs, &overlapMs, &updateNodesMs,
+       &environmentsMs, &renderDataMs, &pickHashMs, &resultCacheMs}};
+
+  ParameterInt sliceCandidates{"candidates", "performance", 0, 0, INT32_MAX};
+  ParameterInt sliceNodes{"nodes", "performance", 0, 0, INT32_MAX};
+  ParameterInt slicePairs{"nodePairs", "performance", 0, 0, INT32_MAX};
+  ParameterInt sliceEdges{"edges", "performance", 0, 0, INT32_MAX};
+  ParameterInt sliceEnvironments{"environments", "performance", 0, 0,
+                                 INT32_MAX};
+
+  Parameter uploadMs{"uploadMs", "performance", 0.f, 0.f, 1E6};
+  Parameter frameP50Ms{"frameP50Ms", "performance", 0.f, 0.f, 1E6};
+  Parameter frameP95Ms{"frameP95Ms", "performance", 0.f, 0.f, 1E6};
+  Parameter frameP99Ms{"frameP99Ms", "performance", 0.f, 0.f, 1E6};
+  ParameterInt cacheHits{"cacheHits", "performance", 0, 0, INT32_MAX};
+  ParameterInt cacheMisses{"cacheMisses", "performance", 0, 0, INT32_MAX};
+  ParameterInt cacheEntries{"cacheEntries", "performance", 0, 0, INT32_MAX};
+  Parameter cacheMB{"cacheMB", "performance", 0.f, 0.f, 1E6};
 };
 
 #endif // CRYSTAL_VIEWER_HPP
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef DIMENSIONS_HPP
+#define DIMENSIONS_HPP
+
+#include <type_traits>
+
+#include "al/math/al_Vec.hpp"
+
+// lattice and slice dimensions that are compiled in. Lattice<N> and
+// Slice<N, M> are instantiated for every N in [minLatticeDim, maxLatticeDim]
+// and M in [minSliceDim, maxSliceDim] with M < N
+static const int minLatticeDim = 3;
+static const int maxLatticeDim = 8;
+static const int minSliceDim = 2;
+static const int maxSliceDim = 3;
+
+// vector handed through the dimension independent interfaces. components
+// beyond the lattice dimension are zero and ignored
+typedef al::Vec<maxLatticeDim, float> LatticeVec;
+
+// compile time dimensions passed to the functions given to
+// dispatchDimensions
+template <int N, int M> struct Dimensions {
+  static const int latticeDim = N;
+  static const int sliceDim = M;
+};
+
+// walks all (N, M) pairs in order until one matches the runtime dimensions
+template <int N, int M, bool End = (N > maxLatticeDim)>
+struct DimensionDispatch {
+  typedef DimensionDispatch<(M < maxSliceDim) ? N : N + 1,
+                            (M < maxSliceDim) ? M + 1 : minSliceDim>
+      Next;
+
+  template <typename F>
+  static bool call(int latticeDim, int sliceDim, F &func) {
+    if (latticeDim == N && sliceDim == M) {
+      return callIf(func, std::integral_constant<bool, (M < N)>());
+    }
+    return Next::call(latticeDim, sliceDim, func);
+  }
+
+  template <typename F> static bool callIf(F &func, std::true_type) {
+    func(Dimensions<N, M>());
+    return true;
+  }
+
+  // slices need at least one normal, so M = N is never instantiated
+  template <typename F> static bool callIf(F & /*func*/, std::false_type) {
+    return false;
+  }
+};
+
+template <int N, int M> struct DimensionDispatch<N, M, true> {
+  template <typename F>
+  static bool call(int /*latticeDim*/, int /*sliceDim*/, F & /*func*/) {
+    return false;
+  }
+};
+
+// calls func(Dimensions<N, M>()) with the compiled in pair equal to
+// latticeDim and sliceDim, so a generic lambda can instantiate the templates
+// for it. returns false if the pair is not supported
+template <typename F>
+bool dispatchDimensions(int latticeDim, int sliceDim, F &&func) {
+  return DimensionDispatch<minLatticeDim, minSliceDim>::call(latticeDim,
+                                                            sliceDim, func);
+}
+
+#endif // DIMENSIONS_HPP
\ No newline at end of file
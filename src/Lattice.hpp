@@ -3,28 +3,33 @@
 
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 
 #include <atomic>
 #include <memory>
-#include <mutex>
-#include <thread>
 
 #include "al/graphics/al_BufferObject.hpp"
 #include "al/math/al_Vec.hpp"
 #include "al/types/al_Color.hpp"
 
+#include "Dimensions.hpp"
+#include "SlabKernel.hpp"
+
 using namespace al;
 
 struct AbstractLattice {
+  virtual ~AbstractLattice() {}
+
   virtual void update() = 0;
   virtual void pollUpdate() = 0;
 
   virtual void generateLattice(int size = 1) = 0;
 
-  virtual void setBasis(Vec5f &value, unsigned int basisNum) = 0;
+  virtual void setBasis(const LatticeVec &value, unsigned int basisNum) = 0;
   virtual void resetBasis() = 0;
-  virtual Vec5f getBasis(unsigned int basisNum) = 0;
+  virtual LatticeVec getBasis(unsigned int basisNum) = 0;
+  virtual void setProjection(const std::array<LatticeVec, 3> &rows) = 0;
 
   virtual int getVertexNum() = 0;
   virtual int getEdgeNum() = 0;
@@ -38,8 +43,10 @@ struct AbstractLattice {
   int latticeSize{1};
 
   bool needsUpdate{true};
-  std::atomic<bool> dirty{false};
+  // valid: grid bounds have been set
+  // version: incremented every time the grid changes
   std::atomic<bool> valid{false};
+  std::atomic<unsigned int> version{0};
 
   bool shouldUploadVertices{true};
   bool shouldUploadEdges{true};
@@ -50,14 +57,56 @@ template <int N> struct Lattice : AbstractLattice {
   std::vector<Vec<N, float>> additionalPoints;
 
   std::vector<Vec<N, float>> unitCell;
+  // the unit cell is drawn projected onto these directions, the first three
+  // axes until a slice sets its own
+  std::array<Vec<N, float>, 3> projection;
   std::vector<Vec3f> projectedVertices;
   std::vector<Color> colors;
   std::vector<Vec3f> edgeStarts;
   std::vector<Vec3f> edgeEnds;
 
-  std::vector<Vec<N, float>> vertices;
-  std::vector<std::atomic<bool>> busy;
-  std::mutex latticeLock;
+  // the (latticeSize + 1)^N integer grid is never stored, points are
+  // enumerated on demand between minCoord and maxCoord in every dimension
+  // with the first coordinate varying fastest
+  int minCoord{0};
+  int maxCoord{1};
+
+  // walks the implicit grid like an odometer, starting from any linear index
+  struct PointIterator {
+    Vec<N, int> point;
+    uint64_t index;
+    int minCoord;
+    int maxCoord;
+
+    PointIterator(uint64_t startIndex, int min, int max)
+        : index(startIndex), minCoord(min), maxCoord(max) {
+      uint64_t width = maxCoord - minCoord + 1;
+      for (int j = 0; j < N; ++j) {
+        point[j] = minCoord + int(startIndex % width);
+        startIndex /= width;
+      }
+    }
+
+    const Vec<N, int> &operator*() const { return point; }
+
+    PointIterator &operator++() {
+      index++;
+      point[0] += 1;
+      for (int j = 0; j < N - 1; ++j) {
+        if (point[j] > maxCoord) {
+          point[j] = minCoord;
+          point[j + 1] += 1;
+        } else {
+          break;
+        }
+      }
+      return *this;
+    }
+
+    bool operator!=(const PointIterator &other) const {
+      return index != other.index;
+    }
+  };
 
   Lattice() {
     latticeDim = N;
@@ -66,12 +115,14 @@ template <int N> struct Lattice : AbstractLattice {
       basis[i] = 0.f;
       basis[i][i] = 1.f;
     }
+    resetProjection();
 
     update();
   }
 
   Lattice(std::shared_ptr<AbstractLattice> oldLattice) {
     latticeDim = N;
+    resetProjection();
 
     if (oldLattice == nullptr) {
       for (int i = 0; i < N; ++i) {
@@ -102,7 +153,6 @@ template <int N> struct Lattice : AbstractLattice {
 
   virtual void update() {
     unitCell.resize((1 << latticeDim) + (unsigned int)additionalPoints.size());
-    projectedVertices.resize(unitCell.size());
     colors.resize(unitCell.size());
 
     for (int i = 0; i < (1 << latticeDim); ++i) {
@@ -113,7 +163,6 @@ template <int N> struct Lattice : AbstractLattice {
           newVec += basis[j];
       }
       unitCell[i] = newVec;
-      projectedVertices[i] = project(newVec);
       colors[i] = Color(1.f);
     }
 
@@ -121,6 +170,18 @@ template <int N> struct Lattice : AbstractLattice {
       std::cerr << "Error: Non-cubic cells not supported yet" << std::endl;
     }
 
+    projectUnitCell();
+    generateLattice(latticeSize);
+  }
+
+  // projects the unit cell vertices and edges for drawing, the grid is not
+  // affected
+  void projectUnitCell() {
+    projectedVertices.resize(unitCell.size());
+    for (unsigned int i = 0; i < unitCell.size(); ++i) {
+      projectedVertices[i] = project(unitCell[i]);
+    }
+
     edgeStarts.resize(latticeDim * (1 << (latticeDim - 1)));
     edgeEnds.resize(latticeDim * (1 << (latticeDim - 1)));
 
@@ -145,47 +206,207 @@ template <int N> struct Lattice : AbstractLattice {
 
     shouldUploadVertices = true;
     shouldUploadEdges = true;
-
-    generateLattice(latticeSize);
   }
 
+  // only updates the grid bounds, points are streamed through begin()/end()
+  // or forEachBlock()
   virtual void generateLattice(int size = 1) {
     latticeSize = size;
 
-    dirty = true;
+    minCoord = std::ceil(-size / 2.f);
+    maxCoord = std::ceil(size / 2.f);
+
+    valid = true;
+    version++;
+  }
+
+  uint64_t getPointNum() {
+    uint64_t pointNum = 1;
+    for (int i = 0; i < N; ++i) {
+      pointNum *= uint64_t(maxCoord - minCoord + 1);
+    }
+    return pointNum;
+  }
+
+  PointIterator pointAt(uint64_t index) {
+    return PointIterator(index, minCoord, maxCoord);
+  }
+
+  PointIterator begin() { return pointAt(0); }
+  PointIterator end() { return pointAt(getPointNum()); }
+
+  // calls func(points, count) for consecutive blocks of at most blockSize
+  // points in [beginIndex, endIndex). only one block is held in memory
+  template <typename F>
+  void forEachBlock(uint64_t beginIndex, uint64_t endIndex, F func,
+                    size_t blockSize = 1024) {
+    std::vector<Vec<N, int>> block(blockSize);
+
+    PointIterator it = pointAt(beginIndex);
+    while (it.index < endIndex) {
+      size_t count = 0;
+      while (count < blockSize && it.index < endIndex) {
+        block[count] = *it;
+        count++;
+        ++it;
+      }
+      func(block.data(), count);
+    }
+  }
+
+  // ranges a coordinate may take so that every offset from the hyperplanes
+  // can still be below depth. rows[dim][k] is what coordinate dim adds to
+  // offset k, restMin/restMax bound what the coordinates below dim can add
+  // to each offset, partial holds the fixed outer ones. with maxNorm every
+  // offset on its own has to be below depth instead of their norm
+  template <int K, int L> struct SlabBounds {
+    const std::array<Vec<L, float>, N> &rows;
+    float depth;
+    int minCoord;
+    int maxCoord;
+    bool maxNorm;
+    std::array<Vec<K, float>, N> restMin;
+    std::array<Vec<K, float>, N> restMax;
+  };
+
+  // returns false if no value of coordinate dim can reach the slab
+  template <int K, int L>
+  static bool slabRange(int dim, const Vec<L, float> &partial,
+                        const SlabBounds<K, L> &bounds, int &low, int &high) {
+    // slack keeps the bound conservative, exact test is left to slabRun
+    static const float slack = 1E-3;
+
+    float lowBound = bounds.minCoord;
+    float highBound = bounds.maxCoord;
+
+    for (int k = 0; k < K; ++k) {
+      float n = bounds.rows[dim][k];
+      float lower = -bounds.depth - partial[k] - bounds.restMax[dim][k];
+      float upper = bounds.depth - partial[k] - bounds.restMin[dim][k];
+
+      if (std::abs(n) < 1E-6) {
+        if (lower > slack || upper < -slack) {
+          return false;
+        }
+        continue;
+      }
+
+      float a = lower / n;
+      float b = upper / n;
+      lowBound = std::max(lowBound, std::min(a, b) - slack);
+      highBound = std::min(highBound, std::max(a, b) + slack);
+    }
 
-    // TODO: spread into threads
+    low = (int)std::ceil(lowBound);
+    high = (int)std::floor(highBound);
+    return low <= high;
+  }
 
-    generateLatticeFunc(size);
+  // enumerates the points of the grid [minCoord, maxCoord]^N that lie within
+  // depth of K hyperplanes through the origin, in the same order as the full
+  // grid, and calls func(point, values) with the integer point and values =
+  // sum of point[d] * rows[d]. the first K values are the offsets from the
+  // hyperplanes, whose norm has to be below depth, the others are carried
+  // along for the caller. each coordinate is bounded using the already fixed
+  // outer coordinates, so whole blocks of the grid that miss the slab are
+  // skipped without being visited. every fixed coordinate adds its row to the
+  // values, and the runs of the innermost coordinate are tested by slabRun,
+  // several points at a time. the outermost coordinate is limited to
+  // [outerMin, outerMax] so callers can split the work. static so it can run
+  // on grid bounds copied from a lattice. with maxNorm the slab is the box
+  // |offset k| < depth, which the coordinate ranges already bound tightly,
+  // so its runs are tested one point at a time
+  template <int K, int L, typename F>
+  static void forEachInSlab(const std::array<Vec<L, float>, N> &rows,
+                            float depth, int minCoord, int maxCoord,
+                            int outerMin, int outerMax, F func,
+                            bool maxNorm = false) {
+    SlabBounds<K, L> bounds{rows, depth, minCoord, maxCoord, maxNorm, {}, {}};
+    bounds.restMin[0] = 0.f;
+    bounds.restMax[0] = 0.f;
+    for (int dim = 1; dim < N; ++dim) {
+      for (int k = 0; k < K; ++k) {
+        float a = minCoord * rows[dim - 1][k];
+        float b = maxCoord * rows[dim - 1][k];
+        bounds.restMin[dim][k] = bounds.restMin[dim - 1][k] + std::min(a, b);
+        bounds.restMax[dim][k] = bounds.restMax[dim - 1][k] + std::max(a, b);
+      }
+    }
 
-    dirty = false;
+    Vec<N, int> point;
+    Vec<L, float> partial(0.f);
+    std::vector<int> hits(maxCoord - minCoord + 1);
+    forEachInSlabDim<K, L>(N - 1, bounds, point, partial, outerMin, outerMax,
+                           hits.data(), func);
   }
 
-  void generateLatticeFunc(int size) {
-    valid = false;
-    int maxSize = int(std::pow(size + 1, latticeDim));
-    vertices.resize(maxSize);
+  template <int K, int L, typename F>
+  static void forEachInSlabDim(int dim, const SlabBounds<K, L> &bounds,
+                               Vec<N, int> &point,
+                               const Vec<L, float> &partial, int outerMin,
+                               int outerMax, int *hits, F &func) {
+    int low, high;
+    if (!slabRange<K, L>(dim, partial, bounds, low, high)) {
+      return;
+    }
 
-    int halfSizeNegative = std::ceil(-size / 2.f);
-    int halfSizePositive = std::ceil(size / 2.f);
+    if (dim == N - 1) {
+      low = std::max(low, outerMin);
+      high = std::min(high, outerMax);
+    }
 
-    Vec<N, int> newVertex(halfSizeNegative);
+    if (dim == 0 && bounds.maxNorm) {
+      const Vec<L, float> &row = bounds.rows[0];
+      Vec<L, float> values;
+      for (int x = low; x <= high; ++x) {
+        bool inside = true;
+        for (int l = 0; l < L; ++l) {
+          values[l] = partial[l] + float(x) * row[l];
+          if (l < K && std::abs(values[l]) >= bounds.depth) {
+            inside = false;
+            break;
+          }
+        }
+        if (inside) {
+          point[0] = x;
+          func(point, values);
+        }
+      }
+      return;
+    }
 
-    for (int i = 0; i < maxSize; ++i) {
-      vertices[i] = newVertex;
+    if (dim == 0) {
+      const Vec<L, float> &row = bounds.rows[0];
+      int hitNum = slabRun<K>(partial.elems(), row.elems(), low, high,
+                              bounds.depth * bounds.depth, hits);
 
-      newVertex[0] += 1;
-      for (int j = 0; j < latticeDim - 1; ++j) {
-        if (newVertex[j] > halfSizePositive) {
-          newVertex[j] = halfSizeNegative;
-          newVertex[j + 1] += 1;
+      Vec<L, float> values;
+      for (int h = 0; h < hitNum; ++h) {
+        point[0] = hits[h];
+        for (int l = 0; l < L; ++l) {
+          values[l] = partial[l] + float(hits[h]) * row[l];
         }
+        func(point, values);
       }
+      return;
+    }
+
+    for (int c = low; c <= high; ++c) {
+      point[dim] = c;
+
+      // c * row rather than a running sum, so rounding does not build up
+      // along the run
+      Vec<L, float> newPartial = partial;
+      for (int l = 0; l < L; ++l) {
+        newPartial[l] += c * bounds.rows[dim][l];
+      }
+
+      forEachInSlabDim<K, L>(dim - 1, bounds, point, newPartial, outerMin,
+                             outerMax, hits, func);
     }
-    valid = true;
   }
 
-  virtual void setBasis(Vec5f &value, unsigned int basisNum) {
+  virtual void setBasis(const LatticeVec &value, unsigned int basisNum) {
     if (basisNum >= basis.size()) {
       std::cerr << "Error: Basis vector write index out of bounds" << std::endl;
       return;
@@ -204,12 +425,12 @@ template <int N> struct Lattice : AbstractLattice {
     needsUpdate = true;
   }
 
-  virtual Vec5f getBasis(unsigned int basisNum) {
+  virtual LatticeVec getBasis(unsigned int basisNum) {
     if (basisNum >= basis.size()) {
       std::cerr << "Error: Basis vector read index out of bounds" << std::endl;
-      return Vec5f();
+      return LatticeVec();
     }
-    return Vec5f(basis[basisNum]);
+    return LatticeVec(basis[basisNum]);
   }
 
   virtual int getVertexNum() { return projectedVertices.size(); }
@@ -234,8 +455,25 @@ template <int N> struct Lattice : AbstractLattice {
   //  return stereographicProjection<4>(stereographicProjection<5>(point5D));
   //}
 
-  inline Vec3f project(Vec<N, float> &point) {
-    return Vec3f{point[0], point[1], point[2]};
+  void resetProjection() {
+    for (int i = 0; i < 3; ++i) {
+      projection[i] = 0.f;
+      projection[i][i] = 1.f;
+    }
+  }
+
+  // draws the unit cell in the space the slice projects onto. rows past the
+  // slice dimension are zero
+  virtual void setProjection(const std::array<LatticeVec, 3> &rows) {
+    for (int i = 0; i < 3; ++i) {
+      projection[i] = rows[i];
+    }
+    projectUnitCell();
+  }
+
+  inline Vec3f project(const Vec<N, float> &point) {
+    return Vec3f{projection[0].dot(point), projection[1].dot(point),
+                 projection[2].dot(point)};
     // return stereographic3D(point);
   }
 
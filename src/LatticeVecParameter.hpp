@@ -0,0 +1,139 @@
+#ifndef LATTICE_VEC_PARAMETER_HPP
+#define LATTICE_VEC_PARAMETER_HPP
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "al/ui/al_Parameter.hpp"
+#include "al/ui/al_ParameterGUI.hpp"
+
+#include "Dimensions.hpp"
+
+using namespace al;
+
+// components of a LatticeVecParameter in its first gui vector
+static const int lowDim = 5;
+
+// a LatticeVec edited in the gui. gui vectors hold at most five components,
+// so the first five are kept in low, under the name the parameter always
+// had, and the rest in high, under name + "High". high is only shown while
+// the dimension does not fit into low
+struct LatticeVecParameter {
+  ParameterVec5 low;
+  ParameterVec5 high;
+  int dimension{lowDim};
+  bool hidden{false};
+
+  LatticeVecParameter(const std::string &name, const LatticeVec &defaultValue)
+      : low(name, "", lowPart(defaultValue)),
+        high(name + "High", "", highPart(defaultValue)) {
+    updateHints();
+  }
+
+  static Vec5f lowPart(const LatticeVec &value) {
+    Vec5f part;
+    for (int i = 0; i < lowDim; ++i) {
+      part[i] = value[i];
+    }
+    return part;
+  }
+
+  static Vec5f highPart(const LatticeVec &value) {
+    Vec5f part(0.f);
+    for (int i = lowDim; i < maxLatticeDim; ++i) {
+      part[i - lowDim] = value[i];
+    }
+    return part;
+  }
+
+  static LatticeVec join(const Vec5f &lowValue, const Vec5f &highValue) {
+    LatticeVec value;
+    for (int i = 0; i < maxLatticeDim; ++i) {
+      value[i] = i < lowDim ? lowValue[i] : highValue[i - lowDim];
+    }
+    return value;
+  }
+
+  LatticeVec get() { return join(low.get(), high.get()); }
+  LatticeVec getDefault() { return join(low.getDefault(), high.getDefault()); }
+
+  void setNoCalls(const LatticeVec &value) {
+    low.setNoCalls(lowPart(value));
+    high.setNoCalls(highPart(value));
+  }
+
+  // func gets the whole vector when either part changes. the callbacks can
+  // run before the new value is stored, so the changed part is taken from
+  // their argument
+  void registerChangeCallback(std::function<void(LatticeVec)> func) {
+    low.registerChangeCallback(
+        [this, func](Vec5f value) { func(join(value, high.get())); });
+    high.registerChangeCallback(
+        [this, func](Vec5f value) { func(join(low.get(), value)); });
+  }
+
+  void setHint(const std::string &hint, float value) {
+    low.setHint(hint, value);
+    high.setHint(hint, value);
+  }
+
+  void removeHint(const std::string &hint) {
+    low.removeHint(hint);
+    high.removeHint(hint);
+  }
+
+  void setDimension(int newDimension) {
+    dimension = newDimension;
+    updateHints();
+  }
+
+  void setHidden(bool newHidden) {
+    hidden = newHidden;
+    updateHints();
+  }
+
+  void updateHints() {
+    low.setHint("dimension", std::min(dimension, lowDim));
+    high.setHint("dimension", std::max(dimension - lowDim, 1));
+
+    if (hidden) {
+      low.setHint("hide", 1.f);
+    } else {
+      low.removeHint("hide");
+    }
+
+    if (hidden || dimension <= lowDim) {
+      high.setHint("hide", 1.f);
+    } else {
+      high.removeHint("hide");
+    }
+  }
+
+  void draw() {
+    ParameterGUI::draw(&low);
+    ParameterGUI::draw(&high);
+  }
+};
+
+typedef std::vector<std::unique_ptr<LatticeVecParameter>> LatticeVecParameters;
+
+// parameters name0 to name(count - 1), defaulting to the unit vectors along
+// their index if unit is set and to zero otherwise
+inline LatticeVecParameters makeLatticeVecParameters(const std::string &name,
+                                                     int count, bool unit) {
+  LatticeVecParameters parameters;
+  for (int i = 0; i < count; ++i) {
+    LatticeVec defaultValue(0.f);
+    if (unit) {
+      defaultValue[i] = 1.f;
+    }
+    parameters.emplace_back(new LatticeVecParameter(
+        name + std::to_string(i), defaultValue));
+  }
+  return parameters;
+}
+
+#endif // LATTICE_VEC_PARAMETER_HPP
\ No newline at end of file
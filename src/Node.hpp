@@ -1,70 +1,422 @@
 #ifndef NODE_HPP
 #define NODE_HPP
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
-#include <string>
+#include <numeric>
 #include <utility>
 #include <vector>
 
 #include "al/graphics/al_VAOMesh.hpp"
 #include "al/math/al_Vec.hpp"
-#include "al/ui/al_Pickable.hpp"
 
 using namespace al;
 
 static const float compareThreshold = 1E-4;
+// cell size of the environment keys. it is wide against compareThreshold, so
+// few neighbour vector components lie close enough to a cell boundary to
+// need a key for either side
+static const float environmentQuantum = 1000 * compareThreshold;
+
+// per node flags, set by the unit cell
+enum NodeFlags : uint8_t {
+  insideUnitCell = 1 << 0,
+  interiorNode = 1 << 1,
+};
 
-struct CrystalNode {
-  unsigned int id;
-  Vec3f pos;
-  unsigned int overlap{0};
-  unsigned int environment;
-  PickableBB pickable;
-  std::vector<std::pair<int, Vec3f>> neighbours;
-
-  Vec3f unitCellCoord;
-  bool insideUnitCell;
-  bool isInteriorNode;
-
-  CrystalNode(std::string name) : pickable(name) {}
-
-  void addNeighbour(CrystalNode &neighbourNode) {
-    Vec3f vecToNeighbour = neighbourNode.pos - pos;
-    neighbours.push_back({neighbourNode.id, vecToNeighbour});
-  }
-
-  void sortNeighbours() {
-    for (int i = 0; i < neighbours.size(); ++i) {
-      for (int j = i + 1; j < neighbours.size(); ++j) {
-        Vec3f diff = neighbours[i].second - neighbours[j].second;
-
-        if (diff[0] > compareThreshold) {
-          neighbours[i].swap(neighbours[j]);
-        } else if (abs(diff[0]) <= compareThreshold) {
-          if (diff[1] > compareThreshold) {
-            neighbours[i].swap(neighbours[j]);
-          } else if (abs(diff[1]) <= compareThreshold) {
-            if (diff[2] > compareThreshold) {
-              neighbours[i].swap(neighbours[j]);
-            } else if (abs(diff[2]) <= compareThreshold) {
-              std::cerr << "Error: overlapping nodes. check overlap detection"
-                        << std::endl;
-            }
-          }
+// integer lattice coordinates, dim of them per entry. they are packed into
+// int8 when every coordinate of the grid fits and into int16 otherwise,
+// which reset decides from the grid bounds
+struct PackedCoords {
+  unsigned int dim{0};
+  bool wide{false};
+  std::vector<int8_t> narrowCoords;
+  std::vector<int16_t> wideCoords;
+
+  void reset(unsigned int newDim, int minCoord, int maxCoord) {
+    dim = newDim;
+    wide = minCoord < INT8_MIN || maxCoord > INT8_MAX;
+    clear();
+  }
+
+  void clear() {
+    narrowCoords.clear();
+    wideCoords.clear();
+  }
+
+  size_t size() const {
+    if (dim == 0) {
+      return 0;
+    }
+    return (wide ? wideCoords.size() : narrowCoords.size()) / dim;
+  }
+
+  size_t bytes() const {
+    return narrowCoords.size() * sizeof(int8_t) +
+           wideCoords.size() * sizeof(int16_t);
+  }
+
+  int get(size_t i, unsigned int d) const {
+    return wide ? wideCoords[i * dim + d] : narrowCoords[i * dim + d];
+  }
+
+  template <typename V> void push(const V &coords) {
+    for (unsigned int d = 0; d < dim; ++d) {
+      if (wide) {
+        wideCoords.push_back(int16_t(coords[d]));
+      } else {
+        narrowCoords.push_back(int8_t(coords[d]));
+      }
+    }
+  }
+
+  // adds entry i of other, which has to be packed the same way
+  void pushFrom(const PackedCoords &other, size_t i) {
+    if (wide) {
+      wideCoords.insert(wideCoords.end(), other.wideCoords.begin() + i * dim,
+                        other.wideCoords.begin() + (i + 1) * dim);
+    } else {
+      narrowCoords.insert(narrowCoords.end(),
+                          other.narrowCoords.begin() + i * dim,
+                          other.narrowCoords.begin() + (i + 1) * dim);
+    }
+  }
+
+  void append(const PackedCoords &other) {
+    wideCoords.insert(wideCoords.end(), other.wideCoords.begin(),
+                      other.wideCoords.end());
+    narrowCoords.insert(narrowCoords.end(), other.narrowCoords.begin(),
+                        other.narrowCoords.end());
+  }
+
+  // same as NodeStore::compactColumn, for entries of dim values
+  void compact(const std::vector<unsigned int> &newIds, unsigned int entryNum,
+               unsigned int noEntry) {
+    compactValues(narrowCoords, newIds, entryNum, noEntry);
+    compactValues(wideCoords, newIds, entryNum, noEntry);
+  }
+
+  template <typename T>
+  void compactValues(std::vector<T> &values,
+                     const std::vector<unsigned int> &newIds,
+                     unsigned int entryNum, unsigned int noEntry) {
+    if (values.empty()) {
+      return;
+    }
+    for (unsigned int i = 0; i * dim < values.size(); ++i) {
+      if (newIds[i] != noEntry && newIds[i] != i) {
+        std::copy(values.begin() + i * dim, values.begin() + (i + 1) * dim,
+                  values.begin() + newIds[i] * dim);
+      }
+    }
+    values.resize(entryNum * dim);
+  }
+};
+
+// slice nodes stored column by column, so passes over one attribute only pull
+// that attribute through the cache. a node id indexes every column
+struct NodeStore {
+  std::vector<Vec3f> pos;
+  std::vector<unsigned int> overlap;
+  std::vector<unsigned int> environment;
+  std::vector<uint8_t> flags;
+  std::vector<Vec3f> unitCellCoord;
+  // coordinate of the lattice point that created the node. points merged
+  // into it later project within compareThreshold of the same position
+  PackedCoords latticeCoord;
+
+  // neighbour graph in compressed sparse row form. the neighbours of node n
+  // are neighbourIds[neighbourOffsets[n]] up to neighbourOffsets[n + 1], with
+  // the vector to each of them at the same index of neighbourVecs
+  std::vector<unsigned int> neighbourOffsets{0};
+  std::vector<unsigned int> neighbourIds;
+  std::vector<Vec3f> neighbourVecs;
+
+  size_t size() const { return pos.size(); }
+
+  unsigned int neighbourNum(unsigned int node) const {
+    return neighbourOffsets[node + 1] - neighbourOffsets[node];
+  }
+
+  size_t bytes() const {
+    return (pos.size() + unitCellCoord.size() + neighbourVecs.size()) *
+               sizeof(Vec3f) +
+           (overlap.size() + environment.size() + neighbourOffsets.size() +
+            neighbourIds.size()) *
+               sizeof(unsigned int) +
+           flags.size() * sizeof(uint8_t) + latticeCoord.bytes();
+  }
+
+  void clear() {
+    pos.clear();
+    overlap.clear();
+    environment.clear();
+    flags.clear();
+    unitCellCoord.clear();
+    latticeCoord.clear();
+    neighbourOffsets.assign(1, 0);
+    neighbourIds.clear();
+    neighbourVecs.clear();
+  }
+
+  // new nodes start without neighbours. their lattice coordinate is entry
+  // coordIdx of coords
+  unsigned int add(const Vec3f &newPos, const PackedCoords &coords,
+                   size_t coordIdx) {
+    pos.push_back(newPos);
+    overlap.push_back(0);
+    environment.push_back(0);
+    flags.push_back(0);
+    unitCellCoord.push_back(Vec3f(0.f));
+    latticeCoord.pushFrom(coords, coordIdx);
+    neighbourOffsets.push_back(neighbourOffsets.back());
+    return pos.size() - 1;
+  }
+
+  // moves node i to newIds[i] in every column, dropping nodes mapped to
+  // noNode. newIds has to keep the order of the remaining nodes
+  template <typename T>
+  static void compactColumn(std::vector<T> &column,
+                            const std::vector<unsigned int> &newIds,
+                            unsigned int nodeNum, unsigned int noNode) {
+    for (unsigned int i = 0; i < column.size(); ++i) {
+      if (newIds[i] != noNode && newIds[i] != i) {
+        column[newIds[i]] = std::move(column[i]);
+      }
+    }
+    column.resize(nodeNum);
+  }
+
+  void compact(const std::vector<unsigned int> &newIds, unsigned int nodeNum,
+               unsigned int noNode) {
+    compactColumn(pos, newIds, nodeNum, noNode);
+    compactColumn(overlap, newIds, nodeNum, noNode);
+    compactColumn(environment, newIds, nodeNum, noNode);
+    compactColumn(flags, newIds, nodeNum, noNode);
+    compactColumn(unitCellCoord, newIds, nodeNum, noNode);
+    latticeCoord.compact(newIds, nodeNum, noNode);
+
+    // ranges only move towards the front, so this works in place. entries
+    // of removed neighbours become noNode until the next buildNeighbours
+    unsigned int entryNum = 0;
+    for (unsigned int i = 0; i + 1 < neighbourOffsets.size(); ++i) {
+      unsigned int begin = neighbourOffsets[i];
+      unsigned int end = neighbourOffsets[i + 1];
+      if (newIds[i] == noNode) {
+        continue;
+      }
+
+      neighbourOffsets[newIds[i]] = entryNum;
+      for (unsigned int e = begin; e < end; ++e, ++entryNum) {
+        neighbourIds[entryNum] = newIds[neighbourIds[e]];
+        neighbourVecs[entryNum] = neighbourVecs[e];
+      }
+    }
+    neighbourOffsets.resize(nodeNum + 1);
+    neighbourOffsets[nodeNum] = entryNum;
+    neighbourIds.resize(entryNum);
+    neighbourVecs.resize(entryNum);
+  }
+
+  // rebuilds the neighbour graph from the first pairNum pairs in two passes,
+  // one counting and one filling. nodes not flagged in isAffected copy their
+  // current, already sorted, neighbours instead. a node whose neighbour count
+  // changed anyway is flagged as well
+  template <typename Pair>
+  void buildNeighbours(const std::vector<Pair> &pairs, size_t pairNum,
+                       std::vector<uint8_t> &isAffected) {
+    std::vector<unsigned int> offsets(size() + 1, 0);
+    for (size_t k = 0; k < pairNum; ++k) {
+      offsets[pairs[k].first + 1]++;
+      offsets[pairs[k].second + 1]++;
+    }
+
+    for (unsigned int n = 0; n < size(); ++n) {
+      if (offsets[n + 1] != neighbourNum(n)) {
+        isAffected[n] = 1;
+      }
+      offsets[n + 1] += offsets[n];
+    }
+
+    std::vector<unsigned int> ids(offsets.back());
+    std::vector<Vec3f> vecs(offsets.back());
+
+    for (unsigned int n = 0; n < size(); ++n) {
+      if (isAffected[n]) {
+        continue;
+      }
+
+      std::copy(neighbourIds.begin() + neighbourOffsets[n],
+                neighbourIds.begin() + neighbourOffsets[n + 1],
+                ids.begin() + offsets[n]);
+      std::copy(neighbourVecs.begin() + neighbourOffsets[n],
+                neighbourVecs.begin() + neighbourOffsets[n + 1],
+                vecs.begin() + offsets[n]);
+    }
+
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t k = 0; k < pairNum; ++k) {
+      unsigned int first = pairs[k].first;
+      unsigned int second = pairs[k].second;
+
+      if (isAffected[first]) {
+        ids[fill[first]] = second;
+        vecs[fill[first]++] = pos[second] - pos[first];
+      }
+      if (isAffected[second]) {
+        ids[fill[second]] = first;
+        vecs[fill[second]++] = pos[first] - pos[second];
+      }
+    }
+
+    neighbourOffsets.swap(offsets);
+    neighbourIds.swap(ids);
+    neighbourVecs.swap(vecs);
+  }
+
+  // sorts neighbours lexicographically by their relative vector, treating
+  // components within compareThreshold as equal. such components are first
+  // snapped to a shared value so the comparison is a strict weak ordering.
+  // the scratch buffers are per thread so sorting many nodes doesn't allocate
+  void sortNeighbours(unsigned int node) {
+    static thread_local std::vector<std::array<float, 3>> keys;
+    static thread_local std::vector<unsigned int> order;
+    static thread_local std::vector<unsigned int> sortedIds;
+    static thread_local std::vector<Vec3f> sortedVecs;
+
+    unsigned int begin = neighbourOffsets[node];
+    size_t neighbourNum = neighbourOffsets[node + 1] - begin;
+    unsigned int *ids = neighbourIds.data() + begin;
+    Vec3f *vecs = neighbourVecs.data() + begin;
+
+    keys.resize(neighbourNum);
+    order.resize(neighbourNum);
+
+    for (int axis = 0; axis < 3; ++axis) {
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(),
+                [&](unsigned int a, unsigned int b) {
+                  return vecs[a][axis] < vecs[b][axis];
+                });
+
+      float snapped = 0.f;
+      for (size_t i = 0; i < neighbourNum; ++i) {
+        float value = vecs[order[i]][axis];
+        if (i == 0 || value - vecs[order[i - 1]][axis] > compareThreshold) {
+          snapped = value;
         }
+        keys[order[i]][axis] = snapped;
       }
     }
+
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+      return keys[a] < keys[b];
+    });
+
+    sortedIds.resize(neighbourNum);
+    sortedVecs.resize(neighbourNum);
+    for (size_t i = 0; i < neighbourNum; ++i) {
+      sortedIds[i] = ids[order[i]];
+      sortedVecs[i] = vecs[order[i]];
+
+      if (i > 0 && keys[order[i]] == keys[order[i - 1]]) {
+        std::cerr << "Error: overlapping nodes. check overlap detection"
+                  << std::endl;
+      }
+    }
+    std::copy(sortedIds.begin(), sortedIds.end(), ids);
+    std::copy(sortedVecs.begin(), sortedVecs.end(), vecs);
+  }
+
+  // cell of environmentQuantum a neighbour vector component falls into. the
+  // cells are shifted by an arbitrary fraction, so simple values such as 0,
+  // 1/8 or ones of the golden ratio are not on their boundaries
+  static int64_t environmentCell(float value) {
+    return (int64_t)std::floor(value / environmentQuantum + 0.6789f);
   }
 
-  bool compareNeighbours(CrystalNode *newNode) {
-    std::vector<std::pair<int, Vec3f>> &newNeighbours = newNode->neighbours;
+  static uint64_t mixEnvironmentKey(uint64_t key, int64_t cell) {
+    return key ^ (uint64_t(cell) + 0x9E3779B97F4A7C15ull + (key << 6) +
+                  (key >> 2));
+  }
+
+  // hash of the sorted neighbour vectors quantised to environmentQuantum.
+  // nodes with the same environment share a key unless a component sits
+  // near a cell boundary, see forEachEnvironmentKey. compareNeighbours makes
+  // the final decision
+  uint64_t environmentKey(unsigned int node) const {
+    uint64_t key = neighbourNum(node);
+    for (unsigned int e = neighbourOffsets[node];
+         e < neighbourOffsets[node + 1]; ++e) {
+      for (int i = 0; i < 3; ++i) {
+        key = mixEnvironmentKey(key, environmentCell(neighbourVecs[e][i]));
+      }
+    }
+    return key;
+  }
+
+  // calls func with every environmentKey a node that compareNeighbours
+  // matches with node can have. a component within compareThreshold of a
+  // cell boundary may fall into the cell on either side, so there are two
+  // keys per such component. returns false without calling func if there
+  // would be more than 1 << maxSplits keys
+  template <typename F>
+  bool forEachEnvironmentKey(unsigned int node, unsigned int maxSplits,
+                             F func) const {
+    static thread_local std::vector<uint64_t> keys;
+
+    // with some margin for the rounding of the division
+    const float margin = 1.01f * compareThreshold;
+    const Vec3f *vecs = neighbourVecs.data() + neighbourOffsets[node];
+    unsigned int num = neighbourNum(node);
+
+    unsigned int splits = 0;
+    for (unsigned int e = 0; e < num; ++e) {
+      for (int i = 0; i < 3; ++i) {
+        splits += environmentCell(vecs[e][i] - margin) !=
+                  environmentCell(vecs[e][i] + margin);
+      }
+    }
+    if (splits > maxSplits) {
+      return false;
+    }
+
+    // the keys share the mixing of the components before the first split
+    keys.assign(1, num);
+    for (unsigned int e = 0; e < num; ++e) {
+      for (int i = 0; i < 3; ++i) {
+        int64_t low = environmentCell(vecs[e][i] - margin);
+        int64_t high = environmentCell(vecs[e][i] + margin);
+        size_t keyNum = keys.size();
+        for (size_t k = 0; k < keyNum; ++k) {
+          if (high != low) {
+            keys.push_back(mixEnvironmentKey(keys[k], high));
+          }
+          keys[k] = mixEnvironmentKey(keys[k], low);
+        }
+      }
+    }
+
+    for (uint64_t key : keys) {
+      func(key);
+    }
+    return true;
+  }
 
-    if (newNeighbours.size() != neighbours.size()) {
+  bool compareNeighbours(unsigned int node, unsigned int otherNode) const {
+    unsigned int num = neighbourNum(node);
+    if (neighbourNum(otherNode) != num) {
       return false;
     }
 
-    for (int i = 0; i < newNeighbours.size(); ++i) {
-      Vec3f diff = neighbours[i].second - newNeighbours[i].second;
+    const Vec3f *vecs = neighbourVecs.data() + neighbourOffsets[node];
+    const Vec3f *otherVecs = neighbourVecs.data() + neighbourOffsets[otherNode];
+    for (unsigned int i = 0; i < num; ++i) {
+      Vec3f diff = vecs[i] - otherVecs[i];
 
       if (diff.sumAbs() > compareThreshold) {
         return false;
@@ -77,9 +429,12 @@ struct CrystalNode {
 
 struct UnitCell {
   std::vector<Vec3f> unitBasis;
-  std::vector<CrystalNode *> cornerNodes;
-  std::vector<CrystalNode *> unitCellNodes;
+  std::vector<unsigned int> cornerNodes;
+  std::vector<unsigned int> unitCellNodes;
   VAOMesh unitCellMesh;
+  // the mesh is sent to the gpu when it is drawn, so a slice can be computed
+  // without a gl context
+  bool meshChanged{false};
 
   void clear(bool clearAll = true) {
     if (clearAll) {
@@ -88,11 +443,11 @@ struct UnitCell {
     unitBasis.clear();
     unitCellNodes.clear();
     unitCellMesh.reset();
-    unitCellMesh.update();
+    meshChanged = true;
   }
 
-  bool hasPoint(CrystalNode *node) {
-    for (std::vector<CrystalNode *>::iterator it = cornerNodes.begin();
+  bool hasPoint(unsigned int node) {
+    for (std::vector<unsigned int>::iterator it = cornerNodes.begin();
          it != cornerNodes.end();) {
       if (*it == node) {
         it = cornerNodes.erase(it);
@@ -106,10 +461,10 @@ struct UnitCell {
     return false;
   }
 
-  bool hasMesh() { return unitCellMesh.valid(); }
+  bool hasMesh() { return unitCellMesh.vertices().size() > 0; }
 
   // returns true when nodes are added to the unit cell
-  bool addNode(CrystalNode *node, int &sliceDim) {
+  bool addNode(unsigned int node, NodeStore &nodes, int &sliceDim) {
     if (cornerNodes.size() > sliceDim) {
       return false;
     }
@@ -117,27 +472,27 @@ struct UnitCell {
     cornerNodes.push_back(node);
 
     if (cornerNodes.size() == sliceDim + 1) {
-      buildMesh(sliceDim);
+      buildMesh(nodes, sliceDim);
     }
 
     return true;
   }
 
-  void buildMesh(int &sliceDim) {
-    Vec3f &origin = cornerNodes[0]->pos;
+  void buildMesh(NodeStore &nodes, int &sliceDim) {
+    Vec3f &origin = nodes.pos[cornerNodes[0]];
     Vec3f endCorner = origin;
 
     unitBasis.resize(sliceDim);
 
     for (int i = 0; i < sliceDim; ++i) {
-      unitBasis[i] = cornerNodes[i + 1]->pos - origin;
+      unitBasis[i] = nodes.pos[cornerNodes[i + 1]] - origin;
       endCorner += unitBasis[i];
     }
 
     unitCellMesh.primitive(Mesh::LINES);
 
     for (int i = 0; i < sliceDim; ++i) {
-      Vec3f &newPoint = cornerNodes[i + 1]->pos;
+      Vec3f &newPoint = nodes.pos[cornerNodes[i + 1]];
       unitCellMesh.vertex(origin);
       unitCellMesh.vertex(newPoint);
 
@@ -157,7 +512,7 @@ struct UnitCell {
       }
     }
 
-    unitCellMesh.update();
+    meshChanged = true;
   }
 };
 
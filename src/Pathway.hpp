@@ -0,0 +1,355 @@
+#ifndef PATHWAY_HPP
+#define PATHWAY_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Dimensions.hpp"
+#include "Lattice.hpp"
+#include "Slice.hpp"
+#include "ThreadPool.hpp"
+
+// lattice basis, miller indices and slice depth at one time of a pathway.
+// vectors beyond the dimensions of the crystal it is played on are ignored
+struct PathwayKeyframe {
+  float time{0.f};
+  std::array<LatticeVec, maxLatticeDim> basis;
+  std::array<LatticeVec, maxLatticeDim - minSliceDim> miller;
+  float sliceDepth{1.f};
+};
+
+// a transformation pathway, such as the bain path from fcc to bcc, as
+// keyframes in seconds that are interpolated linearly in between
+struct Pathway {
+  // sorted by time
+  std::vector<PathwayKeyframe> keyframes;
+
+  // replaces the keyframe at the same time if there is one
+  void addKeyframe(const PathwayKeyframe &keyframe) {
+    auto it = std::lower_bound(
+        keyframes.begin(), keyframes.end(), keyframe,
+        [](const PathwayKeyframe &a, const PathwayKeyframe &b) {
+          return a.time < b.time;
+        });
+    if (it != keyframes.end() && it->time == keyframe.time) {
+      *it = keyframe;
+    } else {
+      keyframes.insert(it, keyframe);
+    }
+  }
+
+  float duration() const {
+    return keyframes.empty() ? 0.f : keyframes.back().time;
+  }
+
+  // pose at time, held before the first and after the last keyframe. there
+  // has to be at least one keyframe
+  PathwayKeyframe at(float time) const {
+    auto next = std::upper_bound(
+        keyframes.begin(), keyframes.end(), time,
+        [](float t, const PathwayKeyframe &keyframe) {
+          return t < keyframe.time;
+        });
+
+    PathwayKeyframe pose;
+    if (next == keyframes.begin()) {
+      pose = keyframes.front();
+    } else if (next == keyframes.end()) {
+      pose = keyframes.back();
+    } else {
+      const PathwayKeyframe &a = *(next - 1);
+      const PathwayKeyframe &b = *next;
+      float t = (time - a.time) / (b.time - a.time);
+
+      for (unsigned int i = 0; i < pose.basis.size(); ++i) {
+        pose.basis[i] = a.basis[i] + t * (b.basis[i] - a.basis[i]);
+      }
+      for (unsigned int i = 0; i < pose.miller.size(); ++i) {
+        pose.miller[i] = a.miller[i] + t * (b.miller[i] - a.miller[i]);
+      }
+      pose.sliceDepth = a.sliceDepth + t * (b.sliceDepth - a.sliceDepth);
+    }
+    pose.time = time;
+    return pose;
+  }
+};
+
+// plays a pathway back in a loop at frameRate frames per second. worker
+// threads compute the frames ahead of the playhead, each with its own
+// lattice and slice, so the slice in the viewer is left alone and the
+// render thread only picks up finished frames.
+//
+// once the first frame is ready the playhead moves in real time, so a loop
+// always takes the duration of the pathway. frames that cannot keep up are
+// skipped instead: workers start on the frame the playhead will have
+// reached when they are expected to finish, and advance returns the most
+// recent finished frame at or before the playhead. slow frames lower the
+// rate the slice changes at, not the playback speed or the rate drawing
+// runs at
+class PathwayPlayer {
+public:
+  static const unsigned int frameRate = 60;
+
+  ~PathwayPlayer() { stop(); }
+
+  // starts playing newPathway from its beginning on threadNum workers, or
+  // as many as the shared thread pool has. the worker slices take the edge
+  // threshold, window and offset of slice, the pathway sets the rest
+  bool start(const Pathway &newPathway,
+             const std::shared_ptr<AbstractSlice> &slice, int latticeSize,
+             unsigned int threadNum = 0) {
+    stop();
+
+    if (newPathway.keyframes.empty()) {
+      std::cerr << "Error: Pathway has no keyframes" << std::endl;
+      return false;
+    }
+
+    pathway = newPathway;
+    frameNum = (unsigned int)(pathway.duration() * frameRate) + 1;
+    playTime = 0.f;
+    playhead = 0;
+    shownIndex = 0;
+    frameSeconds = 0.f;
+    stopping = false;
+
+    if (threadNum == 0) {
+      threadNum = ThreadPool::global().size();
+    }
+    threadNum = std::max(1u, std::min(threadNum, frameNum));
+
+    for (unsigned int i = 0; i < threadNum; ++i) {
+      std::shared_ptr<AbstractLattice> frameLattice;
+      std::shared_ptr<AbstractSlice> frameSlice;
+      dispatchDimensions(slice->latticeDim, slice->sliceDim, [&](auto dims) {
+        typedef decltype(dims) D;
+        auto newLattice = std::make_shared<Lattice<D::latticeDim>>(nullptr);
+        frameSlice = std::make_shared<Slice<D::latticeDim, D::sliceDim>>(
+            slice, newLattice);
+        frameLattice = newLattice;
+      });
+      frameLattice->latticeSize = latticeSize;
+      // the threshold of a frame never changes, so only the node pairs that
+      // are edges are needed
+      frameSlice->maxEdgeThreshold = frameSlice->edgeThreshold;
+
+      workers.emplace_back([this, frameLattice, frameSlice]() {
+        workerLoop(frameLattice, frameSlice);
+      });
+    }
+    return true;
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(frameLock);
+      stopping = true;
+    }
+    frameCondition.notify_all();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+    frames.clear();
+    computing.clear();
+    shownFrame.reset();
+  }
+
+  bool playing() const { return !workers.empty(); }
+
+  // moves the playhead dt seconds on and returns the most recent finished
+  // frame at or before it. null until the first frame is ready, which is
+  // when the playhead starts moving
+  std::shared_ptr<const SliceFrame> advance(float dt) {
+    std::lock_guard<std::mutex> lock(frameLock);
+
+    if (shownFrame) {
+      float loopTime = frameNum / float(frameRate);
+      playTime = std::fmod(playTime + dt, loopTime);
+      unsigned int newPlayhead =
+          std::min(frameNum - 1, (unsigned int)(playTime * frameRate));
+
+      if (newPlayhead != playhead) {
+        playhead = newPlayhead;
+
+        // frames the playhead passed are only needed again on the next loop,
+        // the most recent of them is shown if the one at the playhead is
+        // not ready
+        for (auto it = frames.begin(); it != frames.end();) {
+          if (isAhead(it->first)) {
+            ++it;
+          } else {
+            show(it->first, it->second);
+            it = frames.erase(it);
+          }
+        }
+        frameCondition.notify_all();
+      }
+    }
+
+    auto frame = frames.find(playhead);
+    if (frame != frames.end()) {
+      show(playhead, frame->second);
+    }
+    return shownFrame;
+  }
+
+  float time() {
+    std::lock_guard<std::mutex> lock(frameLock);
+    return playTime;
+  }
+
+  float duration() const { return pathway.duration(); }
+
+  // finished frames ahead of the playhead and their size
+  void cacheStats(unsigned int &frameCount, size_t &bytes) {
+    std::lock_guard<std::mutex> lock(frameLock);
+    frameCount = frames.size();
+    bytes = 0;
+    for (auto &frame : frames) {
+      bytes += frame.second->bytes();
+    }
+  }
+
+private:
+  // the next lookahead frames from the playhead on, wrapping around
+  bool isAhead(unsigned int index) const {
+    unsigned int distance = (index + frameNum - playhead) % frameNum;
+    return distance < std::min(lookahead, frameNum);
+  }
+
+  // frames index is behind the playhead, wrapping around
+  unsigned int behind(unsigned int index) const {
+    return (playhead + frameNum - index) % frameNum;
+  }
+
+  // shows frame unless a more recent one at or before the playhead is shown
+  void show(unsigned int index, std::shared_ptr<const SliceFrame> frame) {
+    if (!shownFrame || behind(index) <= behind(shownIndex)) {
+      shownIndex = index;
+      shownFrame = std::move(frame);
+    }
+  }
+
+  // first frame ahead of the playhead that is neither done nor being
+  // computed and that can be finished before the playhead reaches it. the
+  // ones that cannot are skipped. until the first frame is shown the
+  // playhead waits, so playback starts with it
+  bool nextFrame(unsigned int &index) const {
+    unsigned int window = std::min(lookahead, frameNum);
+    unsigned int lead = 0;
+    if (shownFrame) {
+      lead = std::min(window - 1,
+                      (unsigned int)std::ceil(frameSeconds * frameRate));
+    }
+
+    for (unsigned int i = lead; i < window; ++i) {
+      index = (playhead + i) % frameNum;
+      if (frames.find(index) == frames.end() &&
+          computing.find(index) == computing.end()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workerLoop(std::shared_ptr<AbstractLattice> lattice,
+                  std::shared_ptr<AbstractSlice> slice) {
+    // pose of the previous frame of this worker. the slice only rebuilds
+    // for a changed basis or miller index, a frame that only changes the
+    // depth is an incremental update of the previous one
+    PathwayKeyframe previous;
+    bool first = true;
+
+    while (true) {
+      unsigned int index;
+      {
+        std::unique_lock<std::mutex> lock(frameLock);
+        frameCondition.wait(
+            lock, [&]() { return stopping || nextFrame(index); });
+        if (stopping) {
+          return;
+        }
+        computing.insert(index);
+      }
+
+      auto computeStart = std::chrono::steady_clock::now();
+      PathwayKeyframe pose = pathway.at(index / float(frameRate));
+      for (int i = 0; i < lattice->latticeDim; ++i) {
+        if (first || pose.basis[i] != previous.basis[i]) {
+          lattice->setBasis(pose.basis[i], i);
+          slice->needsUpdate = true;
+        }
+      }
+      lattice->pollUpdate();
+
+      for (int i = 0; i < slice->latticeDim - slice->sliceDim; ++i) {
+        if (first || pose.miller[i] != previous.miller[i]) {
+          slice->setMiller(pose.miller[i], i);
+        }
+      }
+      slice->setDepth(pose.sliceDepth);
+      slice->pollUpdate();
+      slice->waitForResult();
+
+      auto frame = std::make_shared<SliceFrame>();
+      slice->copyFrame(*frame);
+      previous = pose;
+      first = false;
+
+      float seconds = std::chrono::duration<float>(
+                          std::chrono::steady_clock::now() - computeStart)
+                          .count();
+
+      {
+        std::lock_guard<std::mutex> lock(frameLock);
+        computing.erase(index);
+        // running average, so single rebuilds do not skip many frames
+        frameSeconds =
+            frameSeconds > 0.f ? 0.8f * frameSeconds + 0.2f * seconds : seconds;
+
+        if (isAhead(index)) {
+          frames[index] = frame;
+        } else {
+          // the playhead passed it meanwhile, it is still better than an
+          // older frame
+          show(index, frame);
+        }
+      }
+    }
+  }
+
+  Pathway pathway;
+  unsigned int frameNum{1};
+  // frames computed ahead of the playhead, one second of playback
+  unsigned int lookahead{frameRate};
+
+  // guards everything below
+  std::mutex frameLock;
+  std::condition_variable frameCondition;
+  bool stopping{false};
+  float playTime{0.f};
+  unsigned int playhead{0};
+  std::map<unsigned int, std::shared_ptr<const SliceFrame>> frames;
+  std::set<unsigned int> computing;
+  std::shared_ptr<const SliceFrame> shownFrame;
+  unsigned int shownIndex{0};
+  // average wall time a worker takes for a frame
+  float frameSeconds{0.f};
+
+  std::vector<std::thread> workers;
+};
+
+#endif // PATHWAY_HPP
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// a computed result kept in a ResultCache. only the kind of object that
+// stored it knows what it holds
+struct CachedResult {
+  virtual ~CachedResult() {}
+  virtual size_t bytes() const = 0;
+};
+
+// the most recently used results within a byte budget. keys are the bytes
+// of the values of everything a result depends on, hashed by the map.
+// shared by all slices, which look it up from their worker threads
+class ResultCache {
+public:
+  struct Stats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    size_t entries{0};
+    size_t bytes{0};
+    size_t budget{0};
+  };
+
+  ResultCache(size_t newBudget) : budget(newBudget) {}
+
+  // the result stored under key, counted as a hit, or null, counted as a
+  // miss
+  std::shared_ptr<const CachedResult> find(const std::string &key) {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    auto it = index.find(key);
+    if (it == index.end()) {
+      stats.misses++;
+      return nullptr;
+    }
+
+    stats.hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+  }
+
+  // whether a result of this size would be kept
+  bool fits(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    return bytes <= budget;
+  }
+
+  // stores result under key as the most recently used one and drops the
+  // least recently used ones beyond the budget
+  void insert(const std::string &key,
+              std::shared_ptr<const CachedResult> result) {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    erase(key);
+    if (result->bytes() > budget) {
+      return;
+    }
+
+    entries.emplace_front(key, std::move(result));
+    index[key] = entries.begin();
+    stats.bytes += entries.front().second->bytes();
+    evict();
+  }
+
+  void setBudget(size_t newBudget) {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    budget = newBudget;
+    evict();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    entries.clear();
+    index.clear();
+    stats.bytes = 0;
+  }
+
+  Stats getStats() {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    Stats current = stats;
+    current.entries = entries.size();
+    current.budget = budget;
+    return current;
+  }
+
+private:
+  typedef std::pair<std::string, std::shared_ptr<const CachedResult>> Entry;
+  typedef std::list<Entry> EntryList;
+
+  void erase(const std::string &key) {
+    auto it = index.find(key);
+    if (it == index.end()) {
+      return;
+    }
+    stats.bytes -= it->second->second->bytes();
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  void evict() {
+    while (stats.bytes > budget) {
+      stats.bytes -= entries.back().second->bytes();
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+  std::mutex cacheLock;
+  size_t budget;
+  // most recently used first
+  EntryList entries;
+  std::unordered_map<std::string, EntryList::iterator> index;
+  Stats stats;
+};
+
+#endif // RESULT_CACHE_HPP
\ No newline at end of file
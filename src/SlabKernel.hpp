@@ -0,0 +1,151 @@
+#ifndef SLAB_KERNEL_HPP
+#define SLAB_KERNEL_HPP
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SLAB_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit avx instructions in functions marked for it, msvc
+// emits them for the intrinsics regardless of /arch
+#if defined(SLAB_KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SLAB_KERNEL_AVX_TARGET __attribute__((target("avx")))
+#else
+#define SLAB_KERNEL_AVX_TARGET
+#endif
+
+// instruction sets slabRun can use, picked once at runtime
+enum class SimdLevel { scalar, sse, avx };
+
+inline SimdLevel detectSimdLevel() {
+#ifdef SLAB_KERNEL_X86
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool osSavesAvx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+  if (osSavesAvx && (info[2] & (1 << 28))) {
+    return SimdLevel::avx;
+  }
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) {
+    return SimdLevel::avx;
+  }
+#endif
+  // sse2 is part of x86-64
+  return SimdLevel::sse;
+#else
+  return SimdLevel::scalar;
+#endif
+}
+
+inline SimdLevel simdLevel() {
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+// the points of one odometer run have the offsets base[k] + x * step[k]
+// from K hyperplanes, for x from low to high. the slab kernels write the x
+// whose offsets have a norm below sqrt(depthSq) to hits, in increasing
+// order, and return how many there are. every variant evaluates the offsets
+// with the same operations, so they only differ where the compiler contracts
+// them differently
+
+template <int K>
+int slabRunScalar(const float *base, const float *step, int low, int high,
+                  float depthSq, int *hits) {
+  int count = 0;
+  for (int x = low; x <= high; ++x) {
+    float sumSq = 0.f;
+    for (int k = 0; k < K; ++k) {
+      float offset = base[k] + float(x) * step[k];
+      sumSq += offset * offset;
+    }
+    if (sumSq < depthSq) {
+      hits[count++] = x;
+    }
+  }
+  return count;
+}
+
+#ifdef SLAB_KERNEL_X86
+template <int K>
+int slabRunSse(const float *base, const float *step, int low, int high,
+               float depthSq, int *hits) {
+  const __m128 lanes = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+  const __m128 limit = _mm_set1_ps(depthSq);
+
+  int count = 0;
+  int x = low;
+  for (; x + 3 <= high; x += 4) {
+    __m128 xs = _mm_add_ps(_mm_set1_ps(float(x)), lanes);
+    __m128 sumSq = _mm_setzero_ps();
+    for (int k = 0; k < K; ++k) {
+      __m128 offset = _mm_add_ps(_mm_set1_ps(base[k]),
+                                 _mm_mul_ps(xs, _mm_set1_ps(step[k])));
+      sumSq = _mm_add_ps(sumSq, _mm_mul_ps(offset, offset));
+    }
+
+    int mask = _mm_movemask_ps(_mm_cmplt_ps(sumSq, limit));
+    for (int i = 0; mask != 0; ++i, mask >>= 1) {
+      if (mask & 1) {
+        hits[count++] = x + i;
+      }
+    }
+  }
+
+  return count +
+         slabRunScalar<K>(base, step, x, high, depthSq, hits + count);
+}
+
+template <int K>
+SLAB_KERNEL_AVX_TARGET int slabRunAvx(const float *base, const float *step,
+                                      int low, int high, float depthSq,
+                                      int *hits) {
+  const __m256 lanes =
+      _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+  const __m256 limit = _mm256_set1_ps(depthSq);
+
+  int count = 0;
+  int x = low;
+  for (; x + 7 <= high; x += 8) {
+    __m256 xs = _mm256_add_ps(_mm256_set1_ps(float(x)), lanes);
+    __m256 sumSq = _mm256_setzero_ps();
+    for (int k = 0; k < K; ++k) {
+      __m256 offset = _mm256_add_ps(_mm256_set1_ps(base[k]),
+                                    _mm256_mul_ps(xs, _mm256_set1_ps(step[k])));
+      sumSq = _mm256_add_ps(sumSq, _mm256_mul_ps(offset, offset));
+    }
+
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(sumSq, limit, _CMP_LT_OQ));
+    for (int i = 0; mask != 0; ++i, mask >>= 1) {
+      if (mask & 1) {
+        hits[count++] = x + i;
+      }
+    }
+  }
+
+  return count + slabRunSse<K>(base, step, x, high, depthSq, hits + count);
+}
+#endif
+
+template <int K>
+int slabRun(const float *base, const float *step, int low, int high,
+            float depthSq, int *hits) {
+#ifdef SLAB_KERNEL_X86
+  switch (simdLevel()) {
+  case SimdLevel::avx:
+    return slabRunAvx<K>(base, step, low, high, depthSq, hits);
+  case SimdLevel::sse:
+    return slabRunSse<K>(base, step, low, high, depthSq, hits);
+  default:
+    break;
+  }
+#endif
+  return slabRunScalar<K>(base, step, low, high, depthSq, hits);
+}
+
+#endif // SLAB_KERNEL_HPP
\ No newline at end of file
@@ -1,12 +1,17 @@
 #ifndef SLICE_HPP
 #define SLICE_HPP
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -23,14 +28,58 @@
 #include "nlohmann/json.hpp"
 using json = nlohmann::json;
 
+#include "CellReduction.hpp"
 #include "Lattice.hpp"
 #include "Node.hpp"
+#include "ResultCache.hpp"
+#include "SpatialHash.hpp"
+#include "Sublattice.hpp"
+#include "ThreadPool.hpp"
+#include "Timing.hpp"
 
 using namespace al;
 
+// half size of the box drawn and picked around a node
+static const float pickRadius = 0.2f;
+
+// shape in the space of the offsets from the hyperplanes that a lattice point
+// has to fall into, scaled by sliceDepth. the sphere is the slab of the
+// original slicing, the hypercube is the unit hypercube of the lattice grid
+// projected along the slice, which gives the cut-and-project tilings
+enum AcceptanceWindow : unsigned int {
+  sphereWindow,
+  hypercubeWindow,
+  windowNum
+};
+
+static const std::array<const char *, windowNum> windowNames{
+    {"sphere", "hypercube"}};
+
+// render data of one result, kept apart from the slice that computed it so
+// that another slice can show it, see PathwayPlayer
+struct SliceFrame {
+  std::vector<Vec3f> positions;
+  std::vector<Color> colors;
+  std::vector<Vec3f> edgeStarts;
+  std::vector<Vec3f> edgeEnds;
+
+  size_t bytes() const {
+    return positions.size() * sizeof(Vec3f) + colors.size() * sizeof(Color) +
+           (edgeStarts.size() + edgeEnds.size()) * sizeof(Vec3f);
+  }
+};
+
+constexpr int binomial(int n, int k) {
+  return k <= 0 || k >= n ? 1 : binomial(n - 1, k - 1) + binomial(n - 1, k);
+}
+
 struct AbstractSlice {
+  virtual ~AbstractSlice() {}
+
   virtual void update() = 0;
   virtual bool pollUpdate() = 0;
+  virtual bool nodesReady() = 0;
+  virtual void waitForResult() = 0;
 
   virtual void updateNodes() = 0;
   virtual bool updatePickables(std::array<std::string, 4> &nodeInfo,
@@ -38,32 +87,46 @@ struct AbstractSlice {
   virtual void updateUnitCellInfo(std::array<std::string, 5> &unitCellInfo,
                                   Vec4i &cornerNodes) = 0;
   virtual void updateNodeInfo(std::array<std::string, 4> &nodeInfo,
-                              CrystalNode *node = nullptr) = 0;
-  virtual void setMiller(Vec5f &value, unsigned int millerNum) = 0;
+                              int node = -1) = 0;
+  virtual void setMiller(const LatticeVec &value, unsigned int millerNum) = 0;
   virtual void roundMiller() = 0;
   virtual void resetMiller() = 0;
-  virtual Vec5f getMiller(unsigned int millerNum) = 0;
-  virtual void setNormal(Vec5f &value, unsigned int normalNum) = 0;
-  virtual Vec5f getNormal(unsigned int normalNum) = 0;
-  virtual void setSliceBasis(Vec5f &value, unsigned int sliceBasisNum) = 0;
-  virtual Vec5f getSliceBasis(unsigned int sliceBasisNum) = 0;
+  virtual LatticeVec getMiller(unsigned int millerNum) = 0;
+  virtual void setNormal(const LatticeVec &value, unsigned int normalNum) = 0;
+  virtual LatticeVec getNormal(unsigned int normalNum) = 0;
+  virtual void setSliceBasis(const LatticeVec &value,
+                             unsigned int sliceBasisNum) = 0;
+  virtual LatticeVec getSliceBasis(unsigned int sliceBasisNum) = 0;
 
   virtual void setDepth(float newDepth) = 0;
+  virtual void setOffset(const LatticeVec &value) = 0;
+  virtual LatticeVec getOffset() = 0;
   virtual void setThreshold(float newThreshold) = 0;
+  virtual void setWindow(AcceptanceWindow newWindow) = 0;
 
   virtual int getVertexNum() = 0;
   virtual int getEdgeNum() = 0;
+  virtual int getBoxNum() = 0;
+  virtual SliceStats getStats() = 0;
 
   virtual void uploadVertices(BufferObject &vertexbuffer,
                               BufferObject &colorBuffer) = 0;
   virtual void uploadEdges(BufferObject &startBuffer,
                            BufferObject &endBuffer) = 0;
+  virtual void uploadBoxes(BufferObject &positionBuffer,
+                           BufferObject &colorBuffer, bool showAllBoxes) = 0;
+  virtual void copyFrame(SliceFrame &frame) = 0;
+  virtual void showFrame(std::shared_ptr<const SliceFrame> frame) = 0;
 
-  virtual void drawPickables(Graphics &g) = 0;
+  virtual void drawUnitCell(Graphics &g) = 0;
+  virtual void onMouseMove(Graphics &g, const Mouse &m, int w, int h) = 0;
+  virtual void onMouseDown(Graphics &g, const Mouse &m, int w, int h) = 0;
+  virtual void onMouseUp(Graphics &g, const Mouse &m, int w, int h) = 0;
 
   virtual void loadUnitCell(int cornerNode0, int cornerNode1, int cornerNode2,
                             int cornerNode3) = 0;
   virtual void resetUnitCell() = 0;
+  virtual void findUnitCell() = 0;
 
   virtual void exportToTxt(std::string &filePath) = 0;
   virtual void exportToJson(std::string &filePath) = 0;
@@ -73,48 +136,279 @@ struct AbstractSlice {
 
   float sliceDepth{1.0f};
   float edgeThreshold{1.1f};
+  // node pairs up to this length are precomputed, so edgeThreshold changes
+  // below it only select a different prefix of them
+  float maxEdgeThreshold{2.f};
+  AcceptanceWindow window{sphereWindow};
+
+  // full results of earlier computations, possibly shared with other
+  // slices. without one every full update is computed
+  std::shared_ptr<ResultCache> resultCache;
 
   PickableManager pickableManager;
-  VAOMesh box;
+  Mesh box;
 
   bool needsUpdate{true};
+  bool needsDepthUpdate{false};
+  bool needsThresholdUpdate{false};
+  // dirty: the worker has a computation requested or running
+  // valid: at least one result has been published
   std::atomic<bool> dirty{false};
   std::atomic<bool> valid{false};
 
-  bool shouldUploadVertices{false};
-  bool shouldUploadEdges{false};
+  bool shouldUploadBoxes{true};
+
+  // bytes sent to the gpu and time spent sending them since the viewer last
+  // reset them
+  size_t uploadedBytes{0};
+  float uploadMs{0.f};
 };
 
 template <int N, int M> struct Slice : AbstractSlice {
+  // lattice point near the slab: projection onto the slice and offset from
+  // the hyperplanes along their normals
+  struct SliceCandidate {
+    Vec3f pos;
+    Vec<N - M, float> perp;
+  };
+
+  // two nodes closer than maxEdgeThreshold, first < second
+  struct NodePair {
+    unsigned int first;
+    unsigned int second;
+    float length;
+
+    bool operator<(const NodePair &other) const {
+      if (length != other.length) {
+        return length < other.length;
+      }
+      if (first != other.first) {
+        return first < other.first;
+      }
+      return second < other.second;
+    }
+  };
+
+  // everything a computation reads from the gui side, copied on the render
+  // thread when it is requested. flags of requests that arrive while the
+  // worker is busy are merged, so only the latest parameters are computed
+  struct SliceParams {
+    std::array<Vec<N, float>, N - M> millerIndices;
+    std::array<Vec<N, float>, N> latticeBasis;
+    int minCoord;
+    int maxCoord;
+    float sliceDepth;
+    Vec<N - M, float> sliceOffset;
+    float edgeThreshold;
+    float maxEdgeThreshold;
+    AcceptanceWindow window;
+
+    bool fullUpdate{false};
+    bool depthUpdate{false};
+    bool thresholdUpdate{false};
+    bool unitCellUpdate{false};
+  };
+
+  // half open range of changed array elements, empty while begin >= end
+  struct DirtyRange {
+    unsigned int begin{UINT32_MAX};
+    unsigned int end{0};
+
+    void add(unsigned int newBegin, unsigned int newEnd) {
+      begin = std::min(begin, newBegin);
+      end = std::max(end, newEnd);
+    }
+
+    bool empty() const { return begin >= end; }
+
+    void clear() {
+      begin = UINT32_MAX;
+      end = 0;
+    }
+  };
+
+  // render data of one published result
+  struct SliceBuffers {
+    std::vector<Vec3f> projectedVertices;
+    std::vector<Color> colors;
+    std::vector<Vec3f> edgeStarts;
+    std::vector<Vec3f> edgeEnds;
+    std::array<Vec<N, float>, N - M> normals;
+    std::array<Vec<N, float>, M> sliceBasis;
+
+    // elements outside these ranges are the same as in the previous result
+    DirtyRange positionsChanged;
+    DirtyRange colorsChanged;
+    DirtyRange edgesChanged;
+    // origin and corner nodes of the unit cell found for this result, empty
+    // unless one was requested and found
+    std::vector<unsigned int> unitCellCorners;
+    SliceStats stats;
+    unsigned int sequence{0};
+  };
+
   Lattice<N> *lattice;
 
-  std::vector<CrystalNode> nodes;
+  // owned by the worker thread while dirty is set. the render thread only
+  // touches them through the functions that check nodesReady()
+  NodeStore nodes;
+
+  // the only pickable, moved onto the node under the mouse. nodes are hit
+  // tested through pickHash instead
+  PickableBB hoverPickable{"hover"};
+  int hoverNode{-1};
+  int selectedNode{-1};
 
   std::array<Vec<N, float>, N - M> millerIndices;
   std::array<Vec<N, float>, N - M> normals;
   std::array<bool, N - M> isManualNormal;
   std::array<Vec<N, float>, M> sliceBasis;
   std::array<bool, M> isManualSliceBasis;
-
-  std::vector<Vec3f> projectedVertices;
-
-  std::vector<CrystalNode *> environments;
+  // normals and slice basis as one matrix, see computeProjectionRows
+  std::array<Vec<N, float>, N> projectionRows;
+
+  // facets of the hypercube window, see computeWindow. the projected unit
+  // hypercube is a zonotope with at most one pair of facets per N - M - 1
+  // of its N edge directions
+  static const int maxWindowFacets = binomial(N, N - M - 1);
+  std::array<Vec<N - M, float>, maxWindowFacets> windowFacets;
+  unsigned int windowFacetNum{0};
+  // projectionRows with the values of the facet functionals in front
+  std::array<Vec<maxWindowFacets + N, float>, N> windowRows;
+
+  // node id of the first node with each environment
+  std::vector<unsigned int> environments;
   std::vector<Color> colors;
   std::vector<Vec3f> edgeStarts;
   std::vector<Vec3f> edgeEnds;
 
-  UnitCell unitCell;
-
-  Slice() {
-    latticeDim = N;
-    sliceDim = M;
-
-    for (int i = 0; i < N - M; ++i) {
-      millerIndices[i] = 0.f;
-      millerIndices[i][i] = 1.f;
-    }
-  }
+  // instances of the boxes drawn around nodes, rebuilt on the render thread
+  // when the hovered or selected node, the unit cell or the result changes
+  std::vector<Vec3f> boxPositions;
+  std::vector<Color> boxColors;
+  bool showingAllBoxes{false};
 
+  UnitCell unitCell;
+  // corners found by the worker for the result it is computing
+  std::vector<unsigned int> unitCellCorners;
+
+  // cells a few times compareThreshold wide, so an overlap search touches at
+  // most two cells per axis
+  SpatialHash nodeHash{10 * compareThreshold};
+  SpatialHash edgeHash;
+  // cells as wide as a node box, so a box only reaches into the cells next
+  // to the one holding its node. built by the worker with the node bounds
+  SpatialHash pickHash{2 * pickRadius};
+  Vec3f pickMin;
+  Vec3f pickMax;
+
+  // lattice grid version of the last requested full update
+  unsigned int latticeVersion{0};
+
+  // parameters of the computation the worker is running
+  SliceParams params;
+
+  // request handed from the render thread to the worker
+  SliceParams pendingParams;
+  bool hasRequest{false};
+  bool stopping{false};
+  std::mutex requestLock;
+  std::condition_variable requestCondition;
+  std::condition_variable idleCondition;
+  std::thread worker;
+
+  // triple buffered results. the worker fills the back buffer and swaps it
+  // with the ready one, the render thread swaps the ready one with its front
+  // buffer, so neither waits for the other and a result is never torn.
+  // readyBuffer carries newResult while it holds an unseen result
+  static const unsigned int newResult = 4;
+  std::array<SliceBuffers, 3> buffers;
+  unsigned int frontBuffer{0};
+  unsigned int backBuffer{1};
+  std::atomic<unsigned int> readyBuffer{2};
+  std::atomic<unsigned int> resultSequence{0};
+  bool resultTaken{false};
+
+  // results the gpu buffers were last filled from, and how many elements
+  // they hold before they have to be reallocated
+  unsigned int uploadedNodeSequence{0};
+  unsigned int uploadedEdgeSequence{0};
+  size_t positionCapacity{0};
+  size_t colorCapacity{0};
+  size_t edgeCapacity{0};
+  size_t boxCapacity{0};
+
+  // frame drawn instead of the results while it is set, and the frames the
+  // gpu buffers were last filled from
+  std::shared_ptr<const SliceFrame> shownFrame;
+  std::shared_ptr<const SliceFrame> uploadedVertexFrame;
+  std::shared_ptr<const SliceFrame> uploadedEdgeFrame;
+
+  // colours the render thread changed in the front buffer since the last
+  // upload. once there were any, the gpu colours no longer match the ones
+  // the next result's changes are relative to
+  DirtyRange colorEdits;
+  bool colorsEdited{false};
+
+  // shift of the hyperplanes along their normals (phason shift)
+  Vec<N - M, float> sliceOffset{0.f};
+
+  // lattice points within candidateDepth of the hyperplanes through the
+  // origin. nodes are the candidates within sliceDepth of the shifted
+  // hyperplanes, isAccepted tracks which candidates currently are
+  std::vector<SliceCandidate> candidates;
+  // lattice coordinates of the candidates, at the same index
+  PackedCoords candidateCoords;
+  std::vector<uint8_t> isAccepted;
+  float candidateDepth{0.f};
+  float acceptedDepth{0.f};
+
+  // candidates sorted by distance to indexOffset
+  std::vector<unsigned int> candidateOrder;
+  std::vector<float> candidateDistance;
+  Vec<N - M, float> indexOffset{0.f};
+
+  std::vector<uint64_t> environmentKeys;
+
+  // all node pairs up to maxEdgeThreshold sorted by length. the edges are
+  // the first activePairs of them, in the same order as edgeStarts/edgeEnds
+  std::vector<NodePair> nodePairs;
+  unsigned int activePairs{0};
+
+  // elements changed since the last published result
+  DirtyRange positionsChanged;
+  DirtyRange colorsChanged;
+  DirtyRange edgesChanged;
+
+  // stage times and counts of the computation the worker is running
+  SliceStats stats;
+
+  // false while the candidates, node pairs and hashes that depth and
+  // threshold updates build on are missing, after a result was restored
+  bool hasIncrementalState{false};
+
+  // the part of a full update's result that is published and read by the
+  // render thread. the candidates, node pairs and hashes are left out, they
+  // are as large as the rest and only needed once the result is changed
+  struct CachedState : CachedResult {
+    NodeStore nodes;
+    std::array<Vec<N, float>, N - M> normals;
+    std::array<Vec<N, float>, M> sliceBasis;
+    std::array<Vec<N, float>, N> projectionRows;
+    std::array<Vec<N - M, float>, maxWindowFacets> windowFacets;
+    unsigned int windowFacetNum;
+    std::array<Vec<maxWindowFacets + N, float>, N> windowRows;
+    std::vector<unsigned int> environments;
+    std::vector<Color> colors;
+    std::vector<Vec3f> edgeStarts;
+    std::vector<Vec3f> edgeEnds;
+    size_t byteNum;
+
+    virtual size_t bytes() const { return byteNum; }
+  };
+
+  // every slice computes for a lattice on its own worker, so there is no
+  // default constructor that would leave both unset
   Slice(std::shared_ptr<AbstractSlice> oldSlice,
         std::shared_ptr<Lattice<N>> latticePtr) {
     latticeDim = N;
@@ -130,6 +424,9 @@ template <int N, int M> struct Slice : AbstractSlice {
     } else {
       sliceDepth = oldSlice->sliceDepth;
       edgeThreshold = oldSlice->edgeThreshold;
+      maxEdgeThreshold = oldSlice->maxEdgeThreshold;
+      window = oldSlice->window;
+      sliceOffset = oldSlice->getOffset();
 
       int oldLatticeDim = oldSlice->latticeDim;
       int oldSliceDim = oldSlice->sliceDim;
@@ -144,185 +441,1493 @@ template <int N, int M> struct Slice : AbstractSlice {
       }
     }
 
-    addWireBox(box, 0.2f);
-    box.update();
+    addWireBox(box, pickRadius);
+    hoverPickable.set(box);
+
+    worker = std::thread([this]() { workerLoop(); });
+  }
 
-    update();
+  ~Slice() {
+    {
+      std::lock_guard<std::mutex> lock(requestLock);
+      stopping = true;
+    }
+    requestCondition.notify_all();
+    worker.join();
   }
 
+  // hands changed parameters to the worker and takes its latest result.
+  // returns true when a new result has been taken
   virtual bool pollUpdate() {
-    if (needsUpdate) {
-      update();
+    bool fullUpdate = needsUpdate || latticeVersion != lattice->version;
+    if (fullUpdate || needsDepthUpdate || needsThresholdUpdate) {
+      requestUpdate(fullUpdate);
       needsUpdate = false;
-      return true;
+      needsDepthUpdate = false;
+      needsThresholdUpdate = false;
+    }
+
+    takeResult();
+    bool updated = resultTaken;
+    resultTaken = false;
+
+    return updated;
+  }
+
+  void requestUpdate(bool fullUpdate) {
+    // hovered and selected node ids refer to the current nodes
+    pickableManager.clear();
+    hoverNode = -1;
+    selectedNode = -1;
+    hoverPickable.hover = false;
+    hoverPickable.selected = false;
+    shouldUploadBoxes = true;
+
+    latticeVersion = lattice->version;
+
+    {
+      std::lock_guard<std::mutex> lock(requestLock);
+
+      pendingParams.millerIndices = millerIndices;
+      pendingParams.latticeBasis = lattice->basis;
+      pendingParams.minCoord = lattice->minCoord;
+      pendingParams.maxCoord = lattice->maxCoord;
+      pendingParams.sliceDepth = sliceDepth;
+      pendingParams.sliceOffset = sliceOffset;
+      pendingParams.edgeThreshold = edgeThreshold;
+      pendingParams.maxEdgeThreshold =
+          std::max(maxEdgeThreshold, edgeThreshold);
+      pendingParams.window = window;
+
+      pendingParams.fullUpdate |= fullUpdate;
+      pendingParams.depthUpdate |= needsDepthUpdate;
+      pendingParams.thresholdUpdate |= needsThresholdUpdate;
+
+      hasRequest = true;
+      dirty = true;
+    }
+    requestCondition.notify_one();
+  }
+
+  // swaps in the ready result if there is one the render thread has not seen
+  void takeResult() {
+    if (!(readyBuffer.load() & newResult)) {
+      return;
+    }
+
+    frontBuffer = readyBuffer.exchange(frontBuffer) & ~newResult;
+
+    // corner nodes point into the nodes of the previous result
+    unitCell.clear();
+
+    // a unit cell the worker found is loaded only while its nodes are still
+    // the current ones, a later request replaces them anyway
+    const std::vector<unsigned int> &corners =
+        buffers[frontBuffer].unitCellCorners;
+    if (!corners.empty() && nodesReady()) {
+      for (unsigned int corner : corners) {
+        unitCell.addNode(corner, nodes, sliceDim);
+      }
+      updateUnitCell();
+    }
+
+    for (auto &m : isManualNormal) {
+      m = false;
+    }
+
+    for (auto &m : isManualSliceBasis) {
+      m = false;
+    }
+
+    shouldUploadBoxes = true;
+    resultTaken = true;
+  }
+
+  // true when nodes belong to the front buffer and the worker is idle, so the
+  // render thread may read and modify them
+  virtual bool nodesReady() {
+    return !shownFrame && !dirty &&
+           buffers[frontBuffer].sequence == resultSequence;
+  }
+
+  // blocks until the worker has finished all requests and takes the result
+  virtual void waitForResult() {
+    {
+      std::unique_lock<std::mutex> lock(requestLock);
+      idleCondition.wait(lock, [this]() { return !dirty; });
+    }
+    takeResult();
+  }
+
+  void workerLoop() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(requestLock);
+        requestCondition.wait(lock,
+                              [this]() { return stopping || hasRequest; });
+
+        if (stopping) {
+          return;
+        }
+
+        params = pendingParams;
+        pendingParams.fullUpdate = false;
+        pendingParams.depthUpdate = false;
+        pendingParams.thresholdUpdate = false;
+        pendingParams.unitCellUpdate = false;
+        hasRequest = false;
+      }
+
+      stats = SliceStats();
+
+      // a restored result is computed in full the first time it changes.
+      // threshold first, so nodes added by a depth change are connected with
+      // the current threshold like all others
+      bool rebuild = params.fullUpdate ||
+                     ((params.depthUpdate || params.thresholdUpdate) &&
+                      !hasIncrementalState);
+      if (rebuild) {
+        if (!restoreResult()) {
+          update();
+          storeResult();
+        }
+      } else {
+        if (params.thresholdUpdate) {
+          updateThreshold();
+        }
+        if (params.depthUpdate) {
+          updateDepth();
+        }
+      }
+
+      if (rebuild || params.depthUpdate) {
+        ScopedTimer timer(stats.stageMs[pickHashStage]);
+        updatePickHash();
+      }
+      if (params.unitCellUpdate) {
+        searchUnitCell(unitCellCorners);
+      }
+      publishResult();
+
+      {
+        std::lock_guard<std::mutex> lock(requestLock);
+        if (!hasRequest) {
+          dirty = false;
+          idleCondition.notify_all();
+        }
+      }
+    }
+  }
+
+  // N, M and every parameter a full update depends on, written value by
+  // value so struct padding never enters the key. -0 is written as 0, as it
+  // gives the same result
+  std::string resultKey() const {
+    std::string key;
+    auto appendInt = [&key](int32_t value) {
+      key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    auto appendFloat = [&key](float value) {
+      if (value == 0.f) {
+        value = 0.f;
+      }
+      key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    auto appendVec = [&](const auto &vec) {
+      for (int i = 0; i < vec.size(); ++i) {
+        appendFloat(vec[i]);
+      }
+    };
+
+    appendInt(N);
+    appendInt(M);
+    for (auto &miller : params.millerIndices) {
+      appendVec(miller);
+    }
+    for (auto &basis : params.latticeBasis) {
+      appendVec(basis);
+    }
+    appendInt(params.minCoord);
+    appendInt(params.maxCoord);
+    appendFloat(params.sliceDepth);
+    appendVec(params.sliceOffset);
+    appendFloat(params.edgeThreshold);
+    appendFloat(params.maxEdgeThreshold);
+    appendInt(params.window);
+    return key;
+  }
+
+  // size of the worker state in a CachedState
+  size_t stateBytes() const {
+    return nodes.bytes() + environments.size() * sizeof(unsigned int) +
+           colors.size() * sizeof(Color) +
+           (edgeStarts.size() + edgeEnds.size()) * sizeof(Vec3f) +
+           sizeof(CachedState);
+  }
+
+  // copies the result of the full update that just finished into the result
+  // cache, unless it would not fit anyway
+  void storeResult() {
+    if (!resultCache) {
+      return;
+    }
+    ScopedTimer timer(stats.stageMs[cacheStage]);
+
+    size_t byteNum = stateBytes();
+    if (!resultCache->fits(byteNum)) {
+      return;
+    }
+
+    auto state = std::make_shared<CachedState>();
+    state->nodes = nodes;
+    state->normals = normals;
+    state->sliceBasis = sliceBasis;
+    state->projectionRows = projectionRows;
+    state->windowFacets = windowFacets;
+    state->windowFacetNum = windowFacetNum;
+    state->windowRows = windowRows;
+    state->environments = environments;
+    state->colors = colors;
+    state->edgeStarts = edgeStarts;
+    state->edgeEnds = edgeEnds;
+    state->byteNum = byteNum;
+    resultCache->insert(resultKey(), state);
+  }
+
+  // takes the result of an earlier full update with the same parameters
+  // from the result cache instead of computing it. the previous result may
+  // have been anything, so all of it is marked as changed. the state the
+  // incremental updates need is dropped rather than left stale
+  bool restoreResult() {
+    if (!resultCache) {
+      return false;
+    }
+    ScopedTimer timer(stats.stageMs[cacheStage]);
+
+    // the key holds N and M, so only a slice of this type stored it
+    auto state = std::static_pointer_cast<const CachedState>(
+        resultCache->find(resultKey()));
+    if (!state) {
+      return false;
+    }
+
+    nodes = state->nodes;
+    normals = state->normals;
+    sliceBasis = state->sliceBasis;
+    projectionRows = state->projectionRows;
+    windowFacets = state->windowFacets;
+    windowFacetNum = state->windowFacetNum;
+    windowRows = state->windowRows;
+    environments = state->environments;
+    colors = state->colors;
+    edgeStarts = state->edgeStarts;
+    edgeEnds = state->edgeEnds;
+    activePairs = edgeStarts.size();
+
+    candidates.clear();
+    candidateCoords.clear();
+    isAccepted.clear();
+    candidateOrder.clear();
+    candidateDistance.clear();
+    environmentKeys.clear();
+    nodePairs.clear();
+    nodeHash.clear();
+    edgeHash.clear();
+    hasIncrementalState = false;
+
+    positionsChanged.add(0, nodes.size());
+    colorsChanged.add(0, colors.size());
+    edgesChanged.add(0, edgeStarts.size());
+    return true;
+  }
+
+  // fills nodeHash from the nodes, for results restored without it
+  void rebuildNodeHash() {
+    nodeHash.clear();
+    nodeHash.reserve(nodes.size());
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+      nodeHash.insert(nodes.pos[i], i);
+    }
+  }
+
+  void updatePickHash() {
+    pickHash.clear();
+    pickHash.reserve(nodes.size());
+    pickMin.set(std::numeric_limits<float>::max());
+    pickMax.set(std::numeric_limits<float>::lowest());
+
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+      pickHash.insert(nodes.pos[i], i);
+      for (int j = 0; j < 3; ++j) {
+        pickMin[j] = std::min(pickMin[j], nodes.pos[i][j]);
+        pickMax[j] = std::max(pickMax[j], nodes.pos[i][j]);
+      }
+    }
+  }
+
+  // closest node whose box the ray hits, -1 if there is none. a box hit
+  // inside a cell belongs to a node in that cell or one next to it, so the
+  // walk along the ray ends once the closest hit lies before the current
+  // cell's exit
+  int pickNode(const Vec3f &origin, const Vec3f &dir) {
+    float tMin, tMax;
+    if (nodes.size() == 0 ||
+        !intersectRayBox(origin, dir, pickMin - pickRadius,
+                         pickMax + pickRadius, tMin, tMax)) {
+      return -1;
+    }
+
+    int hit = -1;
+    float hitT = tMax;
+    pickHash.forEachCellOnRay(
+        origin, dir, tMin, tMax, [&](int x, int y, int z, float tExit) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+              for (int dz = -1; dz <= 1; ++dz) {
+                pickHash.forEachInCell(
+                    x + dx, y + dy, z + dz, [&](unsigned int id) {
+                      float tEnter, tLeave;
+                      if (intersectRayBox(origin, dir,
+                                          nodes.pos[id] - pickRadius,
+                                          nodes.pos[id] + pickRadius, tEnter,
+                                          tLeave) &&
+                          (hit < 0 || tEnter < hitT)) {
+                        hit = id;
+                        hitT = tEnter;
+                      }
+                    });
+              }
+            }
+          }
+          return hit < 0 || hitT > tExit;
+        });
+
+    return hit;
+  }
+
+  // copies the render data into the back buffer and makes it the ready one
+  void publishResult() {
+    SliceBuffers &back = buffers[backBuffer];
+
+    back.projectedVertices = nodes.pos;
+    back.colors = colors;
+    back.edgeStarts = edgeStarts;
+    back.edgeEnds = edgeEnds;
+    back.normals = normals;
+    back.sliceBasis = sliceBasis;
+    back.positionsChanged = positionsChanged;
+    back.colorsChanged = colorsChanged;
+    back.edgesChanged = edgesChanged;
+    back.unitCellCorners.swap(unitCellCorners);
+    unitCellCorners.clear();
+    back.sequence = resultSequence + 1;
+
+    stats.candidates = candidates.size();
+    stats.nodes = nodes.size();
+    stats.pairs = nodePairs.size();
+    stats.edges = activePairs;
+    stats.environments = environments.size();
+    back.stats = stats;
+
+    positionsChanged.clear();
+    colorsChanged.clear();
+    edgesChanged.clear();
+    resultSequence++;
+
+    backBuffer = readyBuffer.exchange(backBuffer | newResult) & ~newResult;
+    valid = true;
+  }
+
+  virtual void update() {
+    {
+      ScopedTimer timer(stats.stageMs[normalsStage]);
+      computeNormals();
+      computeProjectionRows();
+      computeWindow();
+    }
+
+    nodes.clear();
+    nodes.latticeCoord.reset(N, params.minCoord, params.maxCoord);
+
+    {
+      ScopedTimer timer(stats.stageMs[enumerationStage]);
+      enumerateCandidates();
+    }
+
+    isAccepted.assign(candidates.size(), 0);
+    nodeHash.clear();
+
+    {
+      ScopedTimer timer(stats.stageMs[overlapStage]);
+      for (unsigned int c = 0; c < candidates.size(); ++c) {
+        if (windowNorm(candidates[c].perp - params.sliceOffset) <
+            params.sliceDepth) {
+          isAccepted[c] = 1;
+          acceptCandidate(c);
+        }
+      }
+    }
+
+    acceptedDepth = params.sliceDepth;
+    {
+      ScopedTimer timer(stats.stageMs[enumerationStage]);
+      updateCandidateIndex();
+    }
+
+    updateNodes();
+    hasIncrementalState = true;
+  }
+
+  // fills candidates with the lattice points within candidateDepth of the
+  // hyperplanes through the origin, measured with windowNorm
+  void enumerateCandidates() {
+    // enumerate with some headroom around the slab, so depth and offset
+    // changes can be applied to the candidates without a rebuild. the number
+    // of candidates grows with the headroom to the power of N - M, so with
+    // many normals it is reduced to keep them within about eight times the
+    // slab volume
+    float headroom = N - M <= 3 ? 2.f : std::pow(8.f, 1.f / (N - M));
+    candidateDepth =
+        headroom * (params.sliceDepth + windowNorm(params.sliceOffset));
+
+    if (enumerateSublattice()) {
+      return;
+    }
+
+    if (params.window == hypercubeWindow) {
+      // every facet functional is bounded on its own, which slabRange
+      // prunes exactly
+      enumerateSlab<maxWindowFacets, maxWindowFacets + N>(windowRows, true);
+    } else {
+      enumerateSlab<N - M, N>(projectionRows, false);
+    }
+  }
+
+  // enumerates the candidates through forEachInSlab with the first K of the
+  // L values of rows as the slab offsets and the projectionRows values last
+  template <int K, int L>
+  void enumerateSlab(const std::array<Vec<L, float>, N> &rows, bool maxNorm) {
+    // only visit lattice points that can lie within candidateDepth of the
+    // hyperplanes, split by the outermost coordinate. every range keeps its
+    // points in enumeration order, so merging the ranges in order gives the
+    // same node ids as a serial pass over the whole grid
+    int outerNum = params.maxCoord - params.minCoord + 1;
+    std::vector<std::vector<SliceCandidate>> rangeCandidates(outerNum);
+    std::vector<PackedCoords> rangeCoords(outerNum);
+    for (auto &coords : rangeCoords) {
+      coords.reset(N, params.minCoord, params.maxCoord);
+    }
+
+    ThreadPool::global().parallelFor(
+        0, outerNum,
+        [&](size_t rangeIdx, size_t rangeBegin, size_t rangeEnd) {
+          SliceCandidate candidate;
+          candidate.pos = 0.f;
+          Lattice<N>::template forEachInSlab<K, L>(
+              rows, candidateDepth, params.minCoord, params.maxCoord,
+              params.minCoord + int(rangeBegin),
+              params.minCoord + int(rangeEnd) - 1,
+              [&](const Vec<N, int> &point, const Vec<L, float> &values) {
+                for (int k = 0; k < N - M; ++k) {
+                  candidate.perp[k] = values[L - N + k];
+                }
+                for (int i = 0; i < M; ++i) {
+                  candidate.pos[i] = values[L - M + i];
+                }
+                rangeCandidates[rangeIdx].push_back(candidate);
+                rangeCoords[rangeIdx].push(point);
+              },
+              maxNorm);
+        },
+        rangeCandidates.size());
+
+    candidates.clear();
+    for (auto &range : rangeCandidates) {
+      candidates.insert(candidates.end(), range.begin(), range.end());
+    }
+
+    candidateCoords.reset(N, params.minCoord, params.maxCoord);
+    for (auto &coords : rangeCoords) {
+      candidateCoords.append(coords);
+    }
+  }
+
+  // layers of a periodic slice, see enumerateSublattice. steps are a reduced
+  // basis of the integer points on the hyperplanes, dual its dual basis, and
+  // bases one point near the grid centre in each layer that reaches the slab
+  struct SublatticeLayers {
+    std::array<Vec<N, int>, M> steps;
+    std::array<Vec<N, double>, M> dual;
+    std::vector<Vec<N, int>> bases;
+  };
+
+  // enumerates the candidates of a periodic slice without walking the grid.
+  // if every a_k = sum millerIndices[k][j] * latticeBasis[j] is an integer
+  // vector, the points with the same dot products a_k . c form layers
+  // parallel to the hyperplanes, and each layer is a copy of the rank M
+  // lattice of the integer points on them. its basis comes from the hermite
+  // normal form of the a_k, so only the layers close enough to the
+  // hyperplanes and the points of each layer inside the grid are visited,
+  // however large N is. the points are tested with the same float operations
+  // as in enumerateSlab and sorted into its grid order, so the candidates
+  // and the node ids are the same. returns false if the slice is not
+  // periodic
+  bool enumerateSublattice() {
+    static const int K = N - M;
+    // larger entries could overflow the hermite normal form
+    static const float maxEntry = 1E3f;
+
+    std::array<std::array<int64_t, N>, K> rows;
+    std::array<double, K> rowLengths;
+    for (int k = 0; k < K; ++k) {
+      Vec<N, float> a(0.f);
+      for (int j = 0; j < N; ++j) {
+        a += params.millerIndices[k][j] * params.latticeBasis[j];
+      }
+
+      double lengthSq = 0.0;
+      for (int d = 0; d < N; ++d) {
+        float rounded = std::round(a[d]);
+        if (std::abs(a[d] - rounded) > compareThreshold ||
+            std::abs(rounded) > maxEntry) {
+          return false;
+        }
+        rows[k][d] = int64_t(rounded);
+        lengthSq += double(rounded) * rounded;
+      }
+      rowLengths[k] = std::sqrt(lengthSq);
+    }
+
+    std::array<std::array<int64_t, K>, K> hermite;
+    std::array<std::array<int64_t, N>, N> columns;
+    if (!hermiteNormalForm<N, K>(rows, hermite, columns)) {
+      return false;
+    }
+
+    SublatticeLayers layers;
+    std::vector<Vec<N, double>> kernel(M);
+    for (int i = 0; i < M; ++i) {
+      for (int d = 0; d < N; ++d) {
+        kernel[i][d] = double(columns[K + i][d]);
+      }
+    }
+    lllReduce(kernel);
+
+    std::array<std::array<double, M>, M> gram;
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < M; ++j) {
+        gram[i][j] = kernel[i].dot(kernel[j]);
+      }
+    }
+    if (!invertMatrix<M>(gram)) {
+      return false;
+    }
+    for (int i = 0; i < M; ++i) {
+      layers.dual[i] = 0.0;
+      for (int j = 0; j < M; ++j) {
+        layers.dual[i] += gram[i][j] * kernel[j];
+      }
+      for (int d = 0; d < N; ++d) {
+        layers.steps[i][d] = int(std::round(kernel[i][d]));
+      }
+    }
+
+    // bound on |a_k . c| for the candidates. the hypercube window scaled by
+    // depth reaches depth * sum |g_d| / 2 along each normal, and no grid
+    // point reaches further than the grid corners
+    int maxAbsCoord = std::max(std::abs(params.minCoord),
+                               std::abs(params.maxCoord));
+    std::array<int64_t, K> maxDot;
+    for (int k = 0; k < K; ++k) {
+      double reach = 0.0;
+      double gridReach = 0.0;
+      for (int d = 0; d < N; ++d) {
+        reach += std::abs(projectionRows[d][k]) / 2.0;
+        gridReach += double(std::abs(rows[k][d])) * maxAbsCoord;
+      }
+      if (params.window != hypercubeWindow) {
+        reach = 1.0;
+      }
+      reach = candidateDepth * reach * rowLengths[k] * (1.0 + 1E-4) + 1E-3;
+      maxDot[k] = int64_t(std::floor(std::min(reach, gridReach)));
+    }
+
+    // column k < K of U moves the dot products by column k of hermite, so
+    // the layers are the integer y with a_k . c = (hermite * y)[k]. hermite
+    // is lower triangular, so the y before k fix the range of y[k]
+    std::array<int64_t, K> y;
+    std::array<int64_t, K> yHigh;
+    auto startRange = [&](int k) {
+      int64_t fixed = 0;
+      for (int j = 0; j < k; ++j) {
+        fixed += hermite[k][j] * y[j];
+      }
+      y[k] = ceilDiv(-maxDot[k] - fixed, hermite[k][k]);
+      yHigh[k] = floorDiv(maxDot[k] - fixed, hermite[k][k]);
+    };
+
+    Vec<N, double> centre(0.5 * (params.minCoord + params.maxCoord));
+    int k = 0;
+    startRange(0);
+    while (k >= 0) {
+      if (y[k] > yHigh[k]) {
+        if (--k >= 0) {
+          y[k]++;
+        }
+        continue;
+      }
+      if (k < K - 1) {
+        startRange(++k);
+        continue;
+      }
+
+      Vec<K, float> perp;
+      for (int l = 0; l < K; ++l) {
+        int64_t dot = 0;
+        for (int j = 0; j <= l; ++j) {
+          dot += hermite[l][j] * y[j];
+        }
+        perp[l] = float(dot / rowLengths[l]);
+      }
+
+      // the exact test of every point is left to enumerateLayers
+      if (windowNorm(perp) < candidateDepth * (1.f + 1E-3f) + 1E-3f) {
+        Vec<N, double> base(0.0);
+        for (int j = 0; j < K; ++j) {
+          for (int d = 0; d < N; ++d) {
+            base[d] += double(y[j] * columns[j][d]);
+          }
+        }
+        for (int i = 0; i < M; ++i) {
+          base += std::round(layers.dual[i].dot(centre - base)) * kernel[i];
+        }
+
+        Vec<N, int> point;
+        for (int d = 0; d < N; ++d) {
+          point[d] = int(std::round(base[d]));
+        }
+        layers.bases.push_back(point);
+      }
+      y[k]++;
+    }
+
+    if (params.window == hypercubeWindow) {
+      enumerateLayers<maxWindowFacets, maxWindowFacets + N>(windowRows, true,
+                                                            layers);
+    } else {
+      enumerateLayers<N - M, N>(projectionRows, false, layers);
+    }
+    return true;
+  }
+
+  // fills candidates with the points of the layers that pass the same tests
+  // as in forEachInSlab, with the ranges of layers merged in order
+  template <int K, int L>
+  void enumerateLayers(const std::array<Vec<L, float>, N> &rows, bool maxNorm,
+                       const SublatticeLayers &layers) {
+    size_t rangeNum = std::max<size_t>(
+        1, std::min<size_t>(layers.bases.size(), ThreadPool::global().size()));
+    std::vector<std::vector<SliceCandidate>> rangeCandidates(rangeNum);
+    std::vector<PackedCoords> rangeCoords(rangeNum);
+    for (auto &coords : rangeCoords) {
+      coords.reset(N, params.minCoord, params.maxCoord);
+    }
+
+    float depthSq = candidateDepth * candidateDepth;
+    auto visit = [&](size_t rangeIdx, const Vec<N, int> &point) {
+      // accumulated in the order of forEachInSlab, so the values round the
+      // same way
+      Vec<L, float> partial(0.f);
+      for (int dim = N - 1; dim > 0; --dim) {
+        for (int l = 0; l < L; ++l) {
+          partial[l] += point[dim] * rows[dim][l];
+        }
+      }
+      Vec<L, float> values;
+      for (int l = 0; l < L; ++l) {
+        values[l] = partial[l] + float(point[0]) * rows[0][l];
+      }
+
+      float sumSq = 0.f;
+      for (int l = 0; l < K; ++l) {
+        if (maxNorm && std::abs(values[l]) >= candidateDepth) {
+          return;
+        }
+        sumSq += values[l] * values[l];
+      }
+      if (!maxNorm && sumSq >= depthSq) {
+        return;
+      }
+
+      SliceCandidate candidate;
+      candidate.pos = 0.f;
+      for (int k = 0; k < N - M; ++k) {
+        candidate.perp[k] = values[L - N + k];
+      }
+      for (int i = 0; i < M; ++i) {
+        candidate.pos[i] = values[L - M + i];
+      }
+      rangeCandidates[rangeIdx].push_back(candidate);
+      rangeCoords[rangeIdx].push(point);
+    };
+
+    ThreadPool::global().parallelFor(
+        0, layers.bases.size(),
+        [&](size_t rangeIdx, size_t rangeBegin, size_t rangeEnd) {
+          for (size_t b = rangeBegin; b < rangeEnd; ++b) {
+            forEachInLayer(layers, layers.bases[b],
+                           [&](const Vec<N, int> &point) {
+                             visit(rangeIdx, point);
+                           });
+          }
+        },
+        rangeNum);
+
+    candidates.clear();
+    for (auto &range : rangeCandidates) {
+      candidates.insert(candidates.end(), range.begin(), range.end());
+    }
+
+    candidateCoords.reset(N, params.minCoord, params.maxCoord);
+    for (auto &coords : rangeCoords) {
+      candidateCoords.append(coords);
+    }
+
+    sortCandidatesByGrid();
+  }
+
+  // puts the candidates into the order forEachInSlab visits the grid in,
+  // with the last coordinate outermost, so the nodes accepted from them get
+  // the same ids whichever enumeration found them
+  void sortCandidatesByGrid() {
+    uint64_t gridSize = params.maxCoord - params.minCoord + 1;
+    std::vector<std::pair<uint64_t, unsigned int>> order(candidates.size());
+    for (unsigned int c = 0; c < candidates.size(); ++c) {
+      uint64_t index = 0;
+      for (int d = N - 1; d >= 0; --d) {
+        index = index * gridSize +
+                uint64_t(candidateCoords.get(c, d) - params.minCoord);
+      }
+      order[c] = {index, c};
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<SliceCandidate> sorted(candidates.size());
+    PackedCoords sortedCoords;
+    sortedCoords.reset(N, params.minCoord, params.maxCoord);
+    for (unsigned int c = 0; c < order.size(); ++c) {
+      sorted[c] = candidates[order[c].second];
+      sortedCoords.pushFrom(candidateCoords, order[c].second);
+    }
+    candidates.swap(sorted);
+    std::swap(candidateCoords, sortedCoords);
+  }
+
+  // calls func(point) for the grid points base + sum z[i] * steps[i]. the
+  // dual basis bounds the outer z, the innermost one runs over the exact
+  // range that keeps every coordinate in the grid
+  template <typename F>
+  void forEachInLayer(const SublatticeLayers &layers, const Vec<N, int> &base,
+                      F func) const {
+    std::array<int, M> z;
+    std::array<int, M> zLow;
+    std::array<int, M> zHigh;
+    for (int i = 1; i < M; ++i) {
+      double low = 0.0;
+      double high = 0.0;
+      for (int d = 0; d < N; ++d) {
+        double a = layers.dual[i][d] * (params.minCoord - base[d]);
+        double b = layers.dual[i][d] * (params.maxCoord - base[d]);
+        low += std::min(a, b);
+        high += std::max(a, b);
+      }
+      zLow[i] = int(std::ceil(low - 1E-6));
+      zHigh[i] = int(std::floor(high + 1E-6));
+      if (zLow[i] > zHigh[i]) {
+        return;
+      }
+      z[i] = zLow[i];
+    }
+
+    const Vec<N, int> &step = layers.steps[0];
+    while (true) {
+      Vec<N, int> point = base;
+      for (int i = 1; i < M; ++i) {
+        point += z[i] * layers.steps[i];
+      }
+
+      int64_t low = params.minCoord - params.maxCoord;
+      int64_t high = params.maxCoord - params.minCoord;
+      for (int d = 0; d < N && low <= high; ++d) {
+        int64_t below = params.minCoord - point[d];
+        int64_t above = params.maxCoord - point[d];
+        if (step[d] == 0) {
+          if (below > 0 || above < 0) {
+            low = high + 1;
+          }
+        } else if (step[d] > 0) {
+          low = std::max(low, ceilDiv(below, step[d]));
+          high = std::min(high, floorDiv(above, step[d]));
+        } else {
+          low = std::max(low, ceilDiv(above, step[d]));
+          high = std::min(high, floorDiv(below, step[d]));
+        }
+      }
+      for (int64_t x = low; x <= high; ++x) {
+        func(point + int(x) * step);
+      }
+
+      int i = 1;
+      while (i < M && ++z[i] > zHigh[i]) {
+        z[i] = zLow[i];
+        ++i;
+      }
+      if (i == M) {
+        break;
+      }
+    }
+  }
+
+  // applies a sliceDepth or sliceOffset change by only adding and removing
+  // the candidates that cross the slab boundary, then patching edges and
+  // environments around them. surviving nodes keep their relative order and
+  // new nodes are appended, so ids can differ from a full rebuild
+  void updateDepth() {
+    if (params.sliceDepth + windowNorm(params.sliceOffset) > candidateDepth) {
+      update();
+      return;
+    }
+
+    // finding the changed candidates and merging or adding their nodes
+    ScopedTimer overlapTimer(stats.stageMs[overlapStage]);
+
+    std::vector<unsigned int> entering;
+    std::vector<unsigned int> leaving;
+
+    if (params.sliceOffset == indexOffset) {
+      // only candidates between the old and new depth change state
+      float low = std::min(acceptedDepth, params.sliceDepth);
+      float high = std::max(acceptedDepth, params.sliceDepth);
+      auto first = std::lower_bound(candidateDistance.begin(),
+                                    candidateDistance.end(), low);
+      auto last = std::lower_bound(candidateDistance.begin(),
+                                   candidateDistance.end(), high);
+
+      std::vector<unsigned int> &changed =
+          params.sliceDepth > acceptedDepth ? entering : leaving;
+      for (auto it = first; it != last; ++it) {
+        changed.push_back(candidateOrder[it - candidateDistance.begin()]);
+      }
+
+      std::sort(changed.begin(), changed.end());
+    } else {
+      for (unsigned int c = 0; c < candidates.size(); ++c) {
+        Vec<N - M, float> perp = candidates[c].perp - params.sliceOffset;
+        bool accept = windowNorm(perp) < params.sliceDepth;
+        if (accept && !isAccepted[c]) {
+          entering.push_back(c);
+        } else if (!accept && isAccepted[c]) {
+          leaving.push_back(c);
+        }
+      }
+    }
+
+    std::vector<uint8_t> isRemoved(nodes.size(), 0);
+    std::vector<uint8_t> isAffected(nodes.size(), 0);
+
+    for (unsigned int c : leaving) {
+      isAccepted[c] = 0;
+
+      int n = findNode(candidates[c].pos, &isRemoved);
+      if (n < 0) {
+        continue;
+      }
+
+      if (nodes.overlap[n] > 0) {
+        nodes.overlap[n]--;
+        continue;
+      }
+
+      isRemoved[n] = 1;
+      for (unsigned int e = nodes.neighbourOffsets[n];
+           e < nodes.neighbourOffsets[n + 1]; ++e) {
+        isAffected[nodes.neighbourIds[e]] = 1;
+      }
+    }
+
+    std::vector<NodePair> newPairs;
+
+    for (unsigned int c : entering) {
+      isAccepted[c] = 1;
+
+      int n = findNode(candidates[c].pos, &isRemoved);
+      if (n >= 0) {
+        nodes.overlap[n]++;
+        continue;
+      }
+
+      n = acceptCandidate(c);
+      isRemoved.push_back(0);
+      isAffected.push_back(1);
+
+      if (params.maxEdgeThreshold > 0.f) {
+        edgeHash.forEachNear(
+            nodes.pos[n], params.maxEdgeThreshold, [&](unsigned int j) {
+              if (isRemoved[j]) {
+                return;
+              }
+
+              Vec3f diff = nodes.pos[n] - nodes.pos[j];
+              float length = diff.mag();
+              if (length >= params.maxEdgeThreshold) {
+                return;
+              }
+
+              newPairs.push_back({j, (unsigned int)n, length});
+              if (length < params.edgeThreshold) {
+                isAffected[j] = 1;
+              }
+            });
+        edgeHash.insert(nodes.pos[n], n);
+      }
+    }
+
+    std::sort(newPairs.begin(), newPairs.end());
+    size_t pairNum = nodePairs.size();
+    nodePairs.insert(nodePairs.end(), newPairs.begin(), newPairs.end());
+    std::inplace_merge(nodePairs.begin(), nodePairs.begin() + pairNum,
+                       nodePairs.end());
+
+    overlapTimer.stop();
+
+    acceptedDepth = params.sliceDepth;
+    if (params.sliceOffset != indexOffset) {
+      ScopedTimer timer(stats.stageMs[enumerationStage]);
+      updateCandidateIndex();
+    }
+
+    {
+      ScopedTimer timer(stats.stageMs[updateNodesStage]);
+      removeNodes(isRemoved, isAffected);
+      activePairs = countPairs(params.edgeThreshold);
+      nodes.buildNeighbours(nodePairs, activePairs, isAffected);
+    }
+
+    // only nodes whose neighbourhood changed need new environment keys
+    updateClassification(isAffected, 0);
+  }
+
+  // moves the edge cut to the current edgeThreshold. the neighbour graph is
+  // rebuilt from the pair list, but only the nodes of pairs between the old
+  // and the new threshold are re-sorted and reclassified
+  void updateThreshold() {
+    ScopedTimer timer(stats.stageMs[updateNodesStage]);
+
+    unsigned int newActivePairs = countPairs(params.edgeThreshold);
+    unsigned int first = std::min(activePairs, newActivePairs);
+    unsigned int last = std::max(activePairs, newActivePairs);
+
+    std::vector<uint8_t> isAffected(nodes.size(), 0);
+
+    for (unsigned int k = first; k < last; ++k) {
+      isAffected[nodePairs[k].first] = 1;
+      isAffected[nodePairs[k].second] = 1;
+    }
+
+    activePairs = newActivePairs;
+    nodes.buildNeighbours(nodePairs, activePairs, isAffected);
+    timer.stop();
+
+    updateClassification(isAffected, first);
+  }
+
+  // reclassifies the flagged nodes and refreshes the render data. edges
+  // before edgeBegin are unchanged
+  void updateClassification(const std::vector<uint8_t> &isAffected,
+                            unsigned int edgeBegin) {
+    {
+      ScopedTimer timer(stats.stageMs[environmentStage]);
+      updateEnvironmentKeys(isAffected);
+      classifyEnvironments();
+    }
+
+    ScopedTimer timer(stats.stageMs[renderDataStage]);
+    updateNodeData();
+    updateEdgeData(edgeBegin);
+  }
+
+  // number of pairs shorter than threshold
+  unsigned int countPairs(float threshold) {
+    auto it = std::lower_bound(
+        nodePairs.begin(), nodePairs.end(), threshold,
+        [](const NodePair &pair, float value) { return pair.length < value; });
+    return it - nodePairs.begin();
+  }
+
+  // re-sorts the neighbours and recomputes the environment keys of the
+  // flagged nodes in parallel
+  void updateEnvironmentKeys(const std::vector<uint8_t> &isAffected) {
+    std::vector<unsigned int> affected;
+    environmentKeys.resize(nodes.size());
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+      if (isAffected[i]) {
+        affected.push_back(i);
+      }
+    }
+
+    ThreadPool::global().parallelFor(
+        0, affected.size(),
+        [&](size_t /*rangeIdx*/, size_t rangeBegin, size_t rangeEnd) {
+          for (size_t i = rangeBegin; i < rangeEnd; ++i) {
+            nodes.sortNeighbours(affected[i]);
+            environmentKeys[affected[i]] = nodes.environmentKey(affected[i]);
+          }
+        });
+  }
+
+  // compacts nodes, dropping the removed ones while keeping the order of the
+  // rest, and renumbers every reference to them
+  void removeNodes(std::vector<uint8_t> &isRemoved,
+                   std::vector<uint8_t> &isAffected) {
+    std::vector<unsigned int> newIds(nodes.size(), noEntry);
+    unsigned int nodeNum = 0;
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+      if (!isRemoved[i]) {
+        newIds[i] = nodeNum++;
+      }
+    }
+
+    if (nodeNum == nodes.size()) {
+      return;
+    }
+
+    // every node after the first removed one moves down
+    unsigned int firstRemoved =
+        std::find(isRemoved.begin(), isRemoved.end(), 1) - isRemoved.begin();
+    positionsChanged.add(firstRemoved, nodeNum);
+
+    environmentKeys.resize(nodes.size());
+
+    nodes.compact(newIds, nodeNum, noEntry);
+    NodeStore::compactColumn(environmentKeys, newIds, nodeNum, noEntry);
+    NodeStore::compactColumn(isAffected, newIds, nodeNum, noEntry);
+
+    // the renumbering keeps the relative order, so the pairs stay sorted
+    nodePairs.erase(std::remove_if(nodePairs.begin(), nodePairs.end(),
+                                   [&](const NodePair &pair) {
+                                     return isRemoved[pair.first] ||
+                                            isRemoved[pair.second];
+                                   }),
+                    nodePairs.end());
+    for (auto &pair : nodePairs) {
+      pair.first = newIds[pair.first];
+      pair.second = newIds[pair.second];
+    }
+
+    nodeHash.remap(newIds);
+    if (params.maxEdgeThreshold > 0.f) {
+      edgeHash.remap(newIds);
+    }
+  }
+
+  // lowest id node within compareThreshold of pos, -1 if there is none
+  int findNode(const Vec3f &pos,
+               const std::vector<uint8_t> *isRemoved = nullptr) {
+    int match = -1;
+    nodeHash.forEachNear(pos, compareThreshold, [&](unsigned int id) {
+      if (isRemoved && (*isRemoved)[id]) {
+        return;
+      }
+
+      Vec3f diff = pos - nodes.pos[id];
+      if (diff.sumAbs() < compareThreshold && (match < 0 || int(id) < match)) {
+        match = id;
+      }
+    });
+    return match;
+  }
+
+  // overlapping projections are merged into the lowest id node within
+  // compareThreshold. returns the id of the new node, or of the node the
+  // candidate was merged into
+  int acceptCandidate(unsigned int c) {
+    const SliceCandidate &candidate = candidates[c];
+    int match = findNode(candidate.pos);
+    if (match >= 0) {
+      nodes.overlap[match]++;
+      return match;
+    }
+
+    int id = nodes.add(candidate.pos, candidateCoords, c);
+    nodeHash.insert(candidate.pos, id);
+    positionsChanged.add(id, id + 1);
+
+    return id;
+  }
+
+  // sorts the candidates by windowNorm distance to the current offset so
+  // depth changes become a range lookup
+  void updateCandidateIndex() {
+    indexOffset = params.sliceOffset;
+
+    std::vector<float> distance(candidates.size());
+    for (unsigned int c = 0; c < candidates.size(); ++c) {
+      distance[c] = windowNorm(candidates[c].perp - indexOffset);
+    }
+
+    candidateOrder.resize(candidates.size());
+    std::iota(candidateOrder.begin(), candidateOrder.end(), 0);
+    std::sort(candidateOrder.begin(), candidateOrder.end(),
+              [&](unsigned int a, unsigned int b) {
+                return distance[a] < distance[b];
+              });
+
+    candidateDistance.resize(candidates.size());
+    for (unsigned int i = 0; i < candidates.size(); ++i) {
+      candidateDistance[i] = distance[candidateOrder[i]];
     }
-    return false;
   }
 
-  virtual void update() {
-    dirty = true;
-
-    computeNormals();
+  virtual void updateNodes() {
+    ScopedTimer timer(stats.stageMs[updateNodesStage]);
 
-    unitCell.clear();
+    // cell list with maxEdgeThreshold sized cells, so every node that can
+    // become a neighbour is in one of the 27 cells around a node
+    if (params.maxEdgeThreshold > 0.f) {
+      edgeHash.clear(params.maxEdgeThreshold);
+      edgeHash.reserve(nodes.size());
+      for (int i = 0; i < nodes.size(); ++i) {
+        edgeHash.insert(nodes.pos[i], i);
+      }
+    }
 
-    nodes.clear();
+    // search pairs i < j in parallel, every range sorts its own pairs
+    ThreadPool &pool = ThreadPool::global();
+    std::vector<std::vector<NodePair>> rangePairs(pool.size());
+
+    if (params.maxEdgeThreshold > 0.f) {
+      pool.parallelFor(
+          0, nodes.size(),
+          [&](size_t rangeIdx, size_t rangeBegin, size_t rangeEnd) {
+            std::vector<NodePair> &pairs = rangePairs[rangeIdx];
+            for (unsigned int i = rangeBegin; i < rangeEnd; ++i) {
+              edgeHash.forEachNear(
+                  nodes.pos[i], params.maxEdgeThreshold, [&](unsigned int j) {
+                    if (j <= i) {
+                      return;
+                    }
+                    Vec3f diff = nodes.pos[i] - nodes.pos[j];
+                    float length = diff.mag();
+                    if (length < params.maxEdgeThreshold) {
+                      pairs.push_back({i, j, length});
+                    }
+                  });
+            }
+            std::sort(pairs.begin(), pairs.end());
+          },
+          rangePairs.size());
+    }
 
-    projectedVertices.clear();
-    pickableManager.clear();
+    nodePairs.clear();
+    for (auto &pairs : rangePairs) {
+      size_t pairNum = nodePairs.size();
+      nodePairs.insert(nodePairs.end(), pairs.begin(), pairs.end());
+      std::inplace_merge(nodePairs.begin(), nodePairs.begin() + pairNum,
+                         nodePairs.end());
+    }
 
-    Vec<N - M, float> dist;
+    activePairs = countPairs(params.edgeThreshold);
 
-    for (auto &vertex : lattice->vertices) {
-      // distance to hyperplane
-      for (int i = 0; i < N - M; ++i) {
-        dist[i] = vertex.dot(normals[i]);
-      }
+    std::vector<uint8_t> isAffected(nodes.size(), 1);
+    nodes.buildNeighbours(nodePairs, activePairs, isAffected);
+    timer.stop();
 
-      if (dist.mag() < sliceDepth) {
-        Vec<N, float> newVertex = vertex;
+    updateClassification(isAffected, 0);
+  }
 
-        for (int i = 0; i < N - M; ++i) {
-          newVertex -= dist[i] * normals[i];
-        }
+  // assign environment ids in node order so they stay deterministic. every
+  // environment is stored under all keys a node matching it can have, see
+  // forEachEnvironmentKey, so a node only compares against the environments
+  // under its own key and a miss is a new environment. the few whose
+  // components sit on too many cell boundaries are compared with every node
+  // instead
+  void classifyEnvironments() {
+    // at most 1 << maxSplits keys per environment
+    static const unsigned int maxSplits = 8;
 
-        Vec3f projVertex = project(newVertex);
+    environments.clear();
 
-        bool skip = false;
-        for (auto &node : nodes) {
-          Vec3f diff = projVertex - node.pos;
-          if (diff.sumAbs() < compareThreshold) {
-            node.overlap++;
-            skip = true;
+    std::unordered_map<uint64_t, std::vector<unsigned int>> environmentLookup;
+    environmentLookup.reserve(nodes.size());
+    std::vector<unsigned int> unkeyed;
+
+    for (unsigned int n = 0; n < nodes.size(); ++n) {
+      int environment = -1;
+      auto candidates = environmentLookup.find(environmentKeys[n]);
+      if (candidates != environmentLookup.end()) {
+        for (unsigned int candidate : candidates->second) {
+          if (nodes.compareNeighbours(n, environments[candidate])) {
+            environment = candidate;
             break;
           }
         }
+      }
 
-        if (skip) {
-          continue;
+      for (unsigned int i = 0; environment < 0 && i < unkeyed.size(); ++i) {
+        if (nodes.compareNeighbours(n, environments[unkeyed[i]])) {
+          environment = unkeyed[i];
         }
+      }
 
-        CrystalNode newNode(std::to_string(nodes.size()));
-        newNode.id = nodes.size();
-        newNode.pos = projVertex;
-        newNode.pickable.set(box);
-        newNode.pickable.pose.setPos(newNode.pos);
-        nodes.push_back(std::move(newNode));
+      if (environment < 0) {
+        environment = environments.size();
+        environments.push_back(n);
+        if (!nodes.forEachEnvironmentKey(n, maxSplits, [&](uint64_t key) {
+              environmentLookup[key].push_back(environment);
+            })) {
+          unkeyed.push_back(environment);
+        }
       }
+
+      nodes.environment[n] = environment;
     }
+  }
+
+  // rebuilds the color array uploaded to the gpu, positions are uploaded
+  // straight from the position column. colours are compared with the ones
+  // at the same index in the previous result, so only real changes are sent
+  void updateNodeData() {
+    unsigned int oldNum = colors.size();
+    colors.resize(nodes.size());
+
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+      HSV hsv(float(nodes.environment[i]) / environments.size());
+      hsv.wrapHue();
+      Color color(hsv);
 
-    for (auto &node : nodes) {
-      projectedVertices.push_back(node.pos);
-      pickableManager << node.pickable;
+      if (i >= oldNum || color.r != colors[i].r || color.g != colors[i].g ||
+          color.b != colors[i].b) {
+        colors[i] = color;
+        colorsChanged.add(i, i + 1);
+      }
     }
+  }
 
-    updateNodes();
+  // fills the edge arrays from the active pairs. edges before begin are
+  // unchanged, the rest is compared with the previous result so only edges
+  // that moved are uploaded again
+  void updateEdgeData(unsigned int begin) {
+    unsigned int oldNum = edgeStarts.size();
+    edgeStarts.resize(activePairs);
+    edgeEnds.resize(activePairs);
+
+    for (unsigned int k = begin; k < activePairs; ++k) {
+      Vec3f &start = nodes.pos[nodePairs[k].first];
+      Vec3f &end = nodes.pos[nodePairs[k].second];
+
+      if (k >= oldNum || start != edgeStarts[k] || end != edgeEnds[k]) {
+        edgeStarts[k] = start;
+        edgeEnds[k] = end;
+        edgesChanged.add(k, k + 1);
+      }
+    }
   }
 
-  virtual void updateNodes() {
-    environments.clear();
-    colors.clear();
+  // uploads the elements of data within range. the buffer is reallocated
+  // with some headroom only when data outgrows capacity, and then gets all
+  // of data. returns the number of bytes sent
+  template <typename T>
+  static size_t uploadRange(BufferObject &buffer, size_t &capacity,
+                            const std::vector<T> &data, DirtyRange range) {
+    buffer.bind();
+    if (data.size() > capacity) {
+      capacity = data.size() + data.size() / 2;
+      buffer.data(capacity * sizeof(T), nullptr);
+      range.add(0, data.size());
+    }
 
-    edgeStarts.clear();
-    edgeEnds.clear();
+    range.end = std::min(range.end, (unsigned int)data.size());
+    if (range.empty()) {
+      return 0;
+    }
 
-    for (int i = 0; i < nodes.size(); ++i) {
-      for (int j = i + 1; j < nodes.size(); ++j) {
-        Vec3f diff = nodes[i].pos - nodes[j].pos;
-        if (diff.mag() < edgeThreshold) {
-          nodes[i].addNeighbour(nodes[j]);
-          nodes[j].addNeighbour(nodes[i]);
+    size_t size = (range.end - range.begin) * sizeof(T);
+    buffer.subdata(range.begin * sizeof(T), size, data.data() + range.begin);
+    return size;
+  }
 
-          edgeStarts.push_back(nodes[i].pos);
-          edgeEnds.push_back(nodes[j].pos);
-        }
+  // the changed ranges of a result are relative to the previous one. when
+  // the gpu holds anything else the whole arrays are sent
+  virtual void uploadVertices(BufferObject &vertexBuffer,
+                              BufferObject &colorBuffer) {
+    ScopedTimer timer(uploadMs);
+    SliceBuffers &front = buffers[frontBuffer];
+
+    if (shownFrame) {
+      if (shownFrame != uploadedVertexFrame) {
+        DirtyRange all;
+        all.add(0, shownFrame->positions.size());
+        uploadedBytes += uploadRange(vertexBuffer, positionCapacity,
+                                     shownFrame->positions, all);
+        uploadedBytes +=
+            uploadRange(colorBuffer, colorCapacity, shownFrame->colors, all);
+
+        // no result follows this, so the next one is sent whole
+        uploadedVertexFrame = shownFrame;
+        uploadedNodeSequence = UINT32_MAX;
       }
+      return;
     }
 
-    for (auto &node : nodes) {
-      node.sortNeighbours();
+    if (front.sequence != uploadedNodeSequence) {
+      DirtyRange positions;
+      DirtyRange colors;
+      positions.add(0, front.projectedVertices.size());
+      colors.add(0, front.colors.size());
 
-      bool newEnvironment = true;
-      for (int i = 0; i < environments.size(); ++i) {
-        if (node.compareNeighbours(environments[i])) {
-          newEnvironment = false;
-          node.environment = i;
-          break;
+      if (front.sequence == uploadedNodeSequence + 1) {
+        positions = front.positionsChanged;
+        if (!colorsEdited) {
+          colors = front.colorsChanged;
         }
       }
 
-      if (newEnvironment) {
-        node.environment = environments.size();
-        environments.push_back(&node);
-      }
+      uploadedBytes += uploadRange(vertexBuffer, positionCapacity,
+                                   front.projectedVertices, positions);
+      uploadedBytes +=
+          uploadRange(colorBuffer, colorCapacity, front.colors, colors);
+
+      uploadedNodeSequence = front.sequence;
+      uploadedVertexFrame.reset();
+      colorsEdited = false;
     }
 
-    std::cout << "environment size: " << environments.size() << std::endl;
+    if (!colorEdits.empty()) {
+      uploadedBytes +=
+          uploadRange(colorBuffer, colorCapacity, front.colors, colorEdits);
+      colorEdits.clear();
+      colorsEdited = true;
+    }
+  }
 
-    for (auto &node : nodes) {
-      HSV hsv(float(node.environment) / environments.size());
-      hsv.wrapHue();
-      colors.emplace_back(hsv);
+  virtual void uploadEdges(BufferObject &startBuffer, BufferObject &endBuffer) {
+    ScopedTimer timer(uploadMs);
+    SliceBuffers &front = buffers[frontBuffer];
+
+    if (shownFrame) {
+      if (shownFrame != uploadedEdgeFrame) {
+        DirtyRange all;
+        all.add(0, shownFrame->edgeStarts.size());
+        size_t capacity = edgeCapacity;
+        uploadedBytes +=
+            uploadRange(startBuffer, capacity, shownFrame->edgeStarts, all);
+        uploadedBytes +=
+            uploadRange(endBuffer, edgeCapacity, shownFrame->edgeEnds, all);
+
+        uploadedEdgeFrame = shownFrame;
+        uploadedEdgeSequence = UINT32_MAX;
+      }
+      return;
     }
 
-    shouldUploadVertices = true;
-    shouldUploadEdges = true;
-  }
+    if (front.sequence != uploadedEdgeSequence) {
+      DirtyRange edges;
+      edges.add(0, front.edgeStarts.size());
+      if (front.sequence == uploadedEdgeSequence + 1) {
+        edges = front.edgesChanged;
+      }
 
-  virtual void uploadVertices(BufferObject &vertexBuffer,
-                              BufferObject &colorBuffer) {
-    if (shouldUploadVertices) {
-      vertexBuffer.bind();
-      vertexBuffer.data(projectedVertices.size() * 3 * sizeof(float),
-                        projectedVertices.data());
+      // both buffers always have the same size, so they share a capacity
+      size_t capacity = edgeCapacity;
+      uploadedBytes +=
+          uploadRange(startBuffer, capacity, front.edgeStarts, edges);
+      uploadedBytes +=
+          uploadRange(endBuffer, edgeCapacity, front.edgeEnds, edges);
 
-      colorBuffer.bind();
-      colorBuffer.data(colors.size() * 4 * sizeof(float), colors.data());
-      shouldUploadVertices = false;
+      uploadedEdgeSequence = front.sequence;
+      uploadedEdgeFrame.reset();
     }
   }
 
-  virtual void uploadEdges(BufferObject &startBuffer, BufferObject &endBuffer) {
-    if (shouldUploadEdges) {
-      startBuffer.bind();
-      startBuffer.data(edgeStarts.size() * 3 * sizeof(float),
-                       edgeStarts.data());
+  // moves the hover box onto the node under the mouse, so the pickable
+  // manager only has that one box to test
+  void pickHoverNode(Graphics &g, const Mouse &m, int w, int h) {
+    int node = -1;
+    if (nodesReady()) {
+      Rayd ray = pickableManager.getPickRay(g, m.x(), m.y(), w, h);
+      node = pickNode(Vec3f(ray.o), Vec3f(ray.d));
+    }
 
-      endBuffer.bind();
-      endBuffer.data(edgeEnds.size() * 3 * sizeof(float), edgeEnds.data());
+    if (node == hoverNode) {
+      return;
+    }
 
-      shouldUploadEdges = false;
+    hoverNode = node;
+    shouldUploadBoxes = true;
+    pickableManager.clear();
+    hoverPickable.hover = false;
+    hoverPickable.selected = node >= 0 && node == selectedNode;
+    if (node >= 0) {
+      hoverPickable.pose.setPos(nodes.pos[node]);
+      pickableManager << hoverPickable;
     }
   }
 
+  virtual void onMouseMove(Graphics &g, const Mouse &m, int w, int h) {
+    pickHoverNode(g, m, w, h);
+    pickableManager.onMouseMove(g, m, w, h);
+  }
+
+  virtual void onMouseDown(Graphics &g, const Mouse &m, int w, int h) {
+    pickHoverNode(g, m, w, h);
+    pickableManager.onMouseDown(g, m, w, h);
+  }
+
+  virtual void onMouseUp(Graphics &g, const Mouse &m, int w, int h) {
+    pickableManager.onMouseUp(g, m, w, h);
+  }
+
   // returns true if unit cell has been modified
   virtual bool updatePickables(std::array<std::string, 4> &nodeInfo,
                                bool modifyUnitCell) {
-    for (auto &node : nodes) {
-      auto &pickable = node.pickable;
+    if (!nodesReady() || hoverNode < 0 ||
+        !(hoverPickable.selected.get() && hoverPickable.hover.get())) {
+      return false;
+    }
 
-      if (pickable.selected.get() && pickable.hover.get()) {
-        if (!modifyUnitCell) {
-          updateNodeInfo(nodeInfo, &node);
-          return false;
-        }
+    unsigned int node = hoverNode;
+    selectedNode = node;
+    shouldUploadBoxes = true;
 
-        if (unitCell.hasPoint(&node)) {
-          pickable.selected = false;
-          updateUnitCell();
-          return true;
-        } else if (unitCell.addNode(&node, sliceDim)) {
-          updateUnitCell();
-          return true;
-        }
+    if (!modifyUnitCell) {
+      updateNodeInfo(nodeInfo, node);
+      return false;
+    }
 
-        return false;
-      }
+    if (unitCell.hasPoint(node)) {
+      hoverPickable.selected = false;
+      selectedNode = -1;
+      updateUnitCell();
+      return true;
+    } else if (unitCell.addNode(node, nodes, sliceDim)) {
+      updateUnitCell();
+      return true;
     }
+
     return false;
   }
 
   void updateUnitCell() {
+    std::vector<Color> &colors = buffers[frontBuffer].colors;
+
+    // only colours whose alpha actually changes are uploaded again
+    auto setAlpha = [&](unsigned int i, float alpha) {
+      if (colors[i].a != alpha) {
+        colors[i].a = alpha;
+        colorEdits.add(i, i + 1);
+      }
+    };
+
     // update node metadata based on completed unit cell
     if (unitCell.hasMesh()) {
       Mat3f unitCellMatInv;
@@ -339,38 +1944,36 @@ template <int N, int M> struct Slice : AbstractSlice {
       }
 
       // check if nodes are inside unitCell
+      Vec3f &origin = nodes.pos[unitCell.cornerNodes[0]];
       for (int i = 0; i < nodes.size(); ++i) {
-        Vec3f pos = nodes[i].pos - unitCell.cornerNodes[0]->pos;
-        Vec3f unitCellCoord = unitCellMatInv * pos;
-        nodes[i].unitCellCoord = unitCellCoord;
+        Vec3f unitCellCoord = unitCellMatInv * (nodes.pos[i] - origin);
+        nodes.unitCellCoord[i] = unitCellCoord;
 
         if (unitCellCoord.min() > -compareThreshold &&
             unitCellCoord.max() < (1.f + compareThreshold)) {
-          nodes[i].insideUnitCell = true;
-          nodes[i].isInteriorNode = true;
+          nodes.flags[i] = insideUnitCell | interiorNode;
           // check if node is on faces
           // TODO: add in origin later to count as interior?
           for (int j = 0; j < unitCellCoord.size(); ++j) {
             if (unitCellCoord[j] < compareThreshold &&
                 unitCellCoord[j] > (1.f - compareThreshold)) {
-              nodes[i].isInteriorNode = false;
+              nodes.flags[i] &= ~interiorNode;
             }
           }
-          unitCell.unitCellNodes.push_back(&nodes[i]);
+          unitCell.unitCellNodes.push_back(i);
           // TODO: change color later
-          colors[i].a = 1.f;
+          setAlpha(i, 1.f);
         } else {
-          nodes[i].insideUnitCell = false;
-          nodes[i].isInteriorNode = false;
-          colors[i].a = 0.1f;
+          nodes.flags[i] = 0;
+          setAlpha(i, 0.1f);
         }
       }
     } else {
-      for (auto &c : colors) {
-        c.a = 1.f;
+      for (int i = 0; i < colors.size(); ++i) {
+        setAlpha(i, 1.f);
       }
     }
-    shouldUploadVertices = true;
+    shouldUploadBoxes = true;
   }
 
   virtual void updateUnitCellInfo(std::array<std::string, 5> &unitCellInfo,
@@ -386,45 +1989,143 @@ template <int N, int M> struct Slice : AbstractSlice {
                         std::to_string(unitCell.unitBasis[i].mag());
     }
 
+    if (unitCell.unitBasis.size() == sliceDim) {
+      std::vector<float> lengths;
+      std::vector<float> angles;
+      cellParameters(unitCell.unitBasis, lengths, angles);
+
+      unitCellInfo[3] = "Lengths:";
+      for (float length : lengths) {
+        unitCellInfo[3] += " " + std::to_string(length);
+      }
+      unitCellInfo[4] = sliceDim == 2 ? "Angle (gamma):"
+                                      : "Angles (alpha, beta, gamma):";
+      for (float angle : angles) {
+        unitCellInfo[4] += " " + std::to_string(angle);
+      }
+    }
+
     cornerNodes.set(-1);
     for (int i = 0; i < unitCell.cornerNodes.size(); ++i) {
-      cornerNodes[i] = unitCell.cornerNodes[i]->id;
+      cornerNodes[i] = unitCell.cornerNodes[i];
     }
   }
 
   virtual void updateNodeInfo(std::array<std::string, 4> &nodeInfo,
-                              CrystalNode *node = nullptr) {
+                              int node = -1) {
     nodeInfo[0] = "Node: ";
     nodeInfo[1] = " overlap: ";
     nodeInfo[2] = " env: ";
     nodeInfo[3] = " neighbours: ";
-    if (node) {
-      nodeInfo[0] += std::to_string(node->id);
-      nodeInfo[1] += std::to_string(node->overlap);
-      nodeInfo[2] += std::to_string(node->environment);
-      nodeInfo[3] += std::to_string(node->neighbours.size());
+    if (node >= 0) {
+      nodeInfo[0] += std::to_string(node) + " lattice: (";
+      for (int d = 0; d < N; ++d) {
+        nodeInfo[0] += std::to_string(nodes.latticeCoord.get(node, d)) +
+                       (d < N - 1 ? ", " : ")");
+      }
+      nodeInfo[1] += std::to_string(nodes.overlap[node]);
+      nodeInfo[2] += std::to_string(nodes.environment[node]);
+      nodeInfo[3] += std::to_string(nodes.neighbourNum(node));
+    }
+  }
+
+  // fills the box instances: every node when showAllBoxes is set, then the
+  // selected and the hovered node and the unit cell corners on top
+  void updateBoxInstances(bool showAllBoxes) {
+    boxPositions.clear();
+    boxColors.clear();
+
+    if (showAllBoxes) {
+      boxPositions.assign(nodes.pos.begin(), nodes.pos.end());
+      boxColors.assign(nodes.size(), Color(1.f, 1.f, 1.f, 0.3f));
+    }
+
+    if (selectedNode >= 0) {
+      boxPositions.push_back(nodes.pos[selectedNode]);
+      boxColors.push_back(Color(0.f, 1.f, 1.f));
+    }
+
+    if (hoverNode >= 0 && hoverNode != selectedNode) {
+      boxPositions.push_back(nodes.pos[hoverNode]);
+      boxColors.push_back(Color(1.f, 1.f, 1.f));
+    }
+
+    for (unsigned int cornerNode : unitCell.cornerNodes) {
+      boxPositions.push_back(nodes.pos[cornerNode]);
+      boxColors.push_back(Color(1.f, 1.f, 0.f));
+    }
+  }
+
+  virtual void uploadBoxes(BufferObject &positionBuffer,
+                           BufferObject &colorBuffer, bool showAllBoxes) {
+    ScopedTimer timer(uploadMs);
+
+    if (showAllBoxes != showingAllBoxes) {
+      showingAllBoxes = showAllBoxes;
+      shouldUploadBoxes = true;
+    }
+
+    if (!shouldUploadBoxes) {
+      return;
+    }
+
+    if (nodesReady()) {
+      updateBoxInstances(showAllBoxes);
+      shouldUploadBoxes = false;
+    } else {
+      boxPositions.clear();
+      boxColors.clear();
+    }
+
+    DirtyRange boxes;
+    boxes.add(0, boxPositions.size());
+
+    size_t capacity = boxCapacity;
+    uploadedBytes +=
+        uploadRange(positionBuffer, capacity, boxPositions, boxes);
+    uploadedBytes += uploadRange(colorBuffer, boxCapacity, boxColors, boxes);
+  }
+
+  virtual int getBoxNum() { return boxPositions.size(); }
+
+  // copies the render data of the front buffer
+  virtual void copyFrame(SliceFrame &frame) {
+    SliceBuffers &front = buffers[frontBuffer];
+    frame.positions = front.projectedVertices;
+    frame.colors = front.colors;
+    frame.edgeStarts = front.edgeStarts;
+    frame.edgeEnds = front.edgeEnds;
+  }
+
+  // draws frame instead of the results until it is called with null. the
+  // nodes do not match what is drawn meanwhile, so picking, the boxes and
+  // the unit cell are off
+  virtual void showFrame(std::shared_ptr<const SliceFrame> frame) {
+    if (frame == shownFrame) {
+      return;
     }
+    if (!frame || !shownFrame) {
+      shouldUploadBoxes = true;
+    }
+    shownFrame = frame;
   }
 
-  virtual void drawPickables(Graphics &g) {
-    for (auto &node : nodes) {
-      auto &pickable = node.pickable;
-      g.color(1, 1, 1);
-      pickable.drawBB(g);
+  virtual SliceStats getStats() { return buffers[frontBuffer].stats; }
+
+  virtual void drawUnitCell(Graphics &g) {
+    if (shownFrame) {
+      return;
     }
 
-    g.color(1, 1, 0);
-    for (auto *cornerNode : unitCell.cornerNodes) {
-      g.pushMatrix();
-      g.translate(cornerNode->pos);
-      g.draw(box);
-      g.popMatrix();
+    if (unitCell.meshChanged) {
+      unitCell.unitCellMesh.update();
+      unitCell.meshChanged = false;
     }
 
     g.draw(unitCell.unitCellMesh);
   }
 
-  virtual void setMiller(Vec5f &value, unsigned int millerNum) {
+  virtual void setMiller(const LatticeVec &value, unsigned int millerNum) {
     if (millerNum >= millerIndices.size()) {
       std::cerr << "Error: Miller write index out of bounds(" << millerNum
                 << ")" << std::endl;
@@ -453,84 +2154,224 @@ template <int N, int M> struct Slice : AbstractSlice {
     needsUpdate = true;
   }
 
-  virtual Vec5f getMiller(unsigned int millerNum) {
+  virtual LatticeVec getMiller(unsigned int millerNum) {
     if (millerNum >= millerIndices.size()) {
       std::cerr << "Error: Miller index read out of bounds" << std::endl;
-      return Vec5f();
+      return LatticeVec();
     }
-    return Vec5f(millerIndices[millerNum]);
+    return LatticeVec(millerIndices[millerNum]);
   }
 
-  virtual void setNormal(Vec5f &value, unsigned int normalNum) {
+  virtual void setNormal(const LatticeVec &value, unsigned int normalNum) {
     if (normalNum >= normals.size()) {
       std::cerr << "Error: Normal write out of bounds(" << normalNum << ")"
                 << std::endl;
       return;
     }
 
-    normals[normalNum] = value;
+    buffers[frontBuffer].normals[normalNum] = value;
 
     // TODO: add in additional flags to control update
     isManualNormal[normalNum] = true;
     // needsUpdate = true;
   }
 
-  virtual Vec5f getNormal(unsigned int normalNum) {
+  virtual LatticeVec getNormal(unsigned int normalNum) {
     if (normalNum >= normals.size()) {
       std::cerr << "Error: Normal read out of bounds" << std::endl;
-      return Vec5f();
+      return LatticeVec();
     }
-    return Vec5f(normals[normalNum]);
+    return LatticeVec(buffers[frontBuffer].normals[normalNum]);
   }
 
-  virtual void setSliceBasis(Vec5f &value, unsigned int sliceBasisNum) {
+  virtual void setSliceBasis(const LatticeVec &value,
+                             unsigned int sliceBasisNum) {
     if (sliceBasisNum >= sliceBasis.size()) {
       std::cerr << "Error: Slice Basis write out of bounds(" << sliceBasisNum
                 << ")" << std::endl;
       return;
     }
 
-    sliceBasis[sliceBasisNum] = value;
+    buffers[frontBuffer].sliceBasis[sliceBasisNum] = value;
 
     // TODO: add in additional flags to control update
     isManualSliceBasis[sliceBasisNum] = true;
     // needsUpdate = true;
   }
 
-  virtual Vec5f getSliceBasis(unsigned int sliceBasisNum) {
+  virtual LatticeVec getSliceBasis(unsigned int sliceBasisNum) {
     if (sliceBasisNum >= sliceBasis.size()) {
       std::cerr << "Error: Slice Basis read out of bounds" << std::endl;
-      return Vec5f();
+      return LatticeVec();
     }
-    return Vec5f(sliceBasis[sliceBasisNum]);
+    return LatticeVec(buffers[frontBuffer].sliceBasis[sliceBasisNum]);
   }
 
   virtual void setDepth(float newDepth) {
     sliceDepth = newDepth;
+    needsDepthUpdate = true;
+  }
+
+  virtual void setOffset(const LatticeVec &value) {
+    sliceOffset = value;
+    needsDepthUpdate = true;
+  }
+
+  virtual LatticeVec getOffset() { return LatticeVec(sliceOffset); }
+
+  virtual void setWindow(AcceptanceWindow newWindow) {
+    window = newWindow;
     needsUpdate = true;
   }
 
   virtual void setThreshold(float newThreshold) {
     edgeThreshold = newThreshold;
-    needsUpdate = true;
+
+    if (edgeThreshold > maxEdgeThreshold) {
+      maxEdgeThreshold = edgeThreshold;
+      needsUpdate = true;
+    } else {
+      needsThresholdUpdate = true;
+    }
   }
 
-  Vec<M, float> project(Vec<N, float> &point) {
-    Vec<M, float> projVec{0.f};
+  // row d is what lattice coordinate d adds to the offsets from the
+  // hyperplanes and to the slice coordinates of a point. the slice basis
+  // vectors are taken without their normal components, which is the same as
+  // projecting the point onto the hyperplanes first
+  void computeProjectionRows() {
+    for (int d = 0; d < N; ++d) {
+      for (int k = 0; k < N - M; ++k) {
+        projectionRows[d][k] = normals[k][d];
+      }
+    }
 
     for (int i = 0; i < M; ++i) {
-      // sliceBasis is normalized
-      projVec[i] = point.dot(sliceBasis[i]); //  / sliceBasis[i].mag()
+      Vec<N, float> column = sliceBasis[i];
+      for (auto &n : normals) {
+        column -= n.dot(sliceBasis[i]) * n;
+      }
+      for (int d = 0; d < N; ++d) {
+        projectionRows[d][N - M + i] = column[d];
+      }
+    }
+  }
+
+  // facets of the unit hypercube projected onto the normals, the zonotope
+  // spanned by the generators g_d = projectionRows[d] restricted to the
+  // offsets. every N - M - 1 generators that span a hyperplane give a facet
+  // pair with that normal n at support h = sum |n . g_d| / 2. the facets are
+  // stored as n / h, so the window scaled by depth is where every |f . perp|
+  // is below depth
+  void computeWindow() {
+    static const int K = N - M;
+
+    windowFacetNum = 0;
+    std::array<int, K> subset;
+    for (int i = 0; i < K - 1; ++i) {
+      subset[i] = i;
+    }
+
+    while (true) {
+      // orthonormal basis of the span of the subset
+      std::array<Vec<K, float>, K> span;
+      int rank = 0;
+      for (int i = 0; i < K - 1; ++i) {
+        Vec<K, float> g;
+        for (int k = 0; k < K; ++k) {
+          g[k] = projectionRows[subset[i]][k];
+        }
+        for (int j = 0; j < rank; ++j) {
+          g -= g.dot(span[j]) * span[j];
+        }
+        if (g.mag() > compareThreshold) {
+          span[rank++] = g.normalized();
+        }
+      }
+
+      if (rank == K - 1) {
+        // the standard basis vector that sticks out the most of the span
+        // gives the normal with the least cancellation
+        Vec<K, float> normal(0.f);
+        for (int k = 0; k < K; ++k) {
+          Vec<K, float> e(0.f);
+          e[k] = 1.f;
+          for (int j = 0; j < rank; ++j) {
+            e -= e.dot(span[j]) * span[j];
+          }
+          if (e.mag() > normal.mag()) {
+            normal = e;
+          }
+        }
+        normal.normalize();
+
+        float support = 0.f;
+        for (int d = 0; d < N; ++d) {
+          float dot = 0.f;
+          for (int k = 0; k < K; ++k) {
+            dot += normal[k] * projectionRows[d][k];
+          }
+          support += std::abs(dot) / 2.f;
+        }
+
+        bool isNew = support > compareThreshold;
+        for (unsigned int f = 0; f < windowFacetNum && isNew; ++f) {
+          Vec<K, float> other = windowFacets[f].normalized();
+          isNew = std::abs(other.dot(normal)) < 1.f - compareThreshold;
+        }
+        if (isNew) {
+          windowFacets[windowFacetNum++] = normal / support;
+        }
+      }
+
+      // next subset in lexicographic order
+      int i = K - 2;
+      while (i >= 0 && subset[i] == N - (K - 1) + i) {
+        --i;
+      }
+      if (i < 0) {
+        break;
+      }
+      subset[i]++;
+      for (int j = i + 1; j < K - 1; ++j) {
+        subset[j] = subset[j - 1] + 1;
+      }
+    }
+
+    for (int d = 0; d < N; ++d) {
+      for (int f = 0; f < maxWindowFacets; ++f) {
+        windowRows[d][f] = 0.f;
+        if (f < int(windowFacetNum)) {
+          for (int k = 0; k < K; ++k) {
+            windowRows[d][f] += windowFacets[f][k] * projectionRows[d][k];
+          }
+        }
+      }
+      for (int l = 0; l < N; ++l) {
+        windowRows[d][maxWindowFacets + l] = projectionRows[d][l];
+      }
+    }
+  }
+
+  // gauge of the acceptance window, a point is accepted while it is below
+  // sliceDepth
+  float windowNorm(const Vec<N - M, float> &perp) const {
+    if (params.window != hypercubeWindow) {
+      return perp.mag();
     }
 
-    return projVec;
+    float norm = 0.f;
+    for (unsigned int f = 0; f < windowFacetNum; ++f) {
+      norm = std::max(norm, std::abs(windowFacets[f].dot(perp)));
+    }
+    return norm;
   }
 
   void computeNormals() {
     for (int i = 0; i < N - M; ++i) {
       normals[i] = 0;
       for (int j = 0; j < N; ++j) {
-        normals[i] += millerIndices[i][j] * lattice->basis[j];
+        normals[i] += params.millerIndices[i][j] * params.latticeBasis[j];
       }
       normals[i].normalize();
     }
@@ -538,7 +2379,7 @@ template <int N, int M> struct Slice : AbstractSlice {
     for (int i = 0; i < M; ++i) {
       Vec<N, float> &newBasis = sliceBasis[i];
 
-      newBasis = lattice->basis[i];
+      newBasis = params.latticeBasis[i];
       newBasis.normalize();
 
       for (auto &n : normals) {
@@ -554,7 +2395,7 @@ template <int N, int M> struct Slice : AbstractSlice {
         //           << std::endl;
         // TODO: add in ability to adjust basis
         for (int remainingIdx = M; remainingIdx < N; ++remainingIdx) {
-          newBasis = lattice->basis[remainingIdx];
+          newBasis = params.latticeBasis[remainingIdx];
           // if (remainingIdx == M) {
           //   newBasis =
           //       Vec4f(1.f, -0.5f * std::sqrt(2.f), 0.f, 0.5f *
@@ -575,7 +2416,7 @@ template <int N, int M> struct Slice : AbstractSlice {
         }
 
         if (newBasis.sumAbs() < compareThreshold) {
-          std::cout << "Unable to create orthogonal basis, randomizing"
+          std::cerr << "Unable to create orthogonal basis, randomizing"
                     << std::endl;
           do {
             for (int j = 0; j < N; ++j) {
@@ -592,30 +2433,34 @@ template <int N, int M> struct Slice : AbstractSlice {
 
       newBasis.normalize();
     }
+  }
 
-    for (auto &m : isManualNormal) {
-      m = false;
+  virtual int getVertexNum() {
+    if (shownFrame) {
+      return shownFrame->positions.size();
     }
-
-    for (auto &m : isManualSliceBasis) {
-      m = false;
+    return buffers[frontBuffer].projectedVertices.size();
+  }
+  virtual int getEdgeNum() {
+    if (shownFrame) {
+      return shownFrame->edgeStarts.size();
     }
+    return buffers[frontBuffer].edgeStarts.size();
   }
 
-  virtual int getVertexNum() { return projectedVertices.size(); }
-  virtual int getEdgeNum() { return edgeStarts.size(); }
-
   virtual void loadUnitCell(int cornerNode0, int cornerNode1, int cornerNode2,
                             int cornerNode3) {
+    waitForResult();
+
     unitCell.clear();
     if (cornerNode0 >= 0) {
-      unitCell.addNode(&nodes[cornerNode0], sliceDim);
+      unitCell.addNode(cornerNode0, nodes, sliceDim);
       if (cornerNode1 >= 0) {
-        unitCell.addNode(&nodes[cornerNode1], sliceDim);
+        unitCell.addNode(cornerNode1, nodes, sliceDim);
         if (cornerNode2 >= 0) {
-          unitCell.addNode(&nodes[cornerNode2], sliceDim);
+          unitCell.addNode(cornerNode2, nodes, sliceDim);
           if (cornerNode3 >= 0) {
-            unitCell.addNode(&nodes[cornerNode3], sliceDim);
+            unitCell.addNode(cornerNode3, nodes, sliceDim);
           }
         }
       }
@@ -626,11 +2471,189 @@ template <int N, int M> struct Slice : AbstractSlice {
 
   virtual void resetUnitCell() {
     unitCell.clear();
+    shouldUploadBoxes = true;
     // TODO: add in color adjustment
   }
 
+  // asks the worker to search the current nodes for a unit cell. it is
+  // loaded when the result is taken, see searchUnitCell
+  virtual void findUnitCell() {
+    {
+      std::lock_guard<std::mutex> lock(requestLock);
+      pendingParams.unitCellUpdate = true;
+      hasRequest = true;
+      dirty = true;
+    }
+    requestCondition.notify_one();
+  }
+
+  // finds the primitive translations of the slice on the worker and returns
+  // the origin and corner nodes of the reduced cell spanned by them at the
+  // node closest to the centre. candidate translations are the differences
+  // to the nodes around it, taken from pickHash, and a difference is a
+  // translation if it maps every node around the centre onto a node. the
+  // search radius grows until sliceDim independent translations are found,
+  // so the shortest independent ones are found first, which for up to three
+  // dimensions span the whole translation lattice. they are then lll reduced
+  // and put into niggli form. only the middle of the slice is searched, away
+  // from its border, so slices too small to repeat there fail, as do
+  // aperiodic ones
+  bool searchUnitCell(std::vector<unsigned int> &corners) {
+    // node lookups before an aperiodic or huge slice is given up on
+    static const unsigned int maxLookups = 1 << 20;
+
+    corners.clear();
+    if (nodes.size() <= (unsigned int)sliceDim) {
+      std::cout << "Unable to find unit cell: Not enough nodes" << std::endl;
+      return false;
+    }
+
+    if (!hasIncrementalState) {
+      rebuildNodeHash();
+    }
+
+    Vec3f centre = (pickMin + pickMax) / 2.f;
+    unsigned int origin = 0;
+    for (unsigned int i = 1; i < nodes.size(); ++i) {
+      if ((nodes.pos[i] - centre).magSqr() <
+          (nodes.pos[origin] - centre).magSqr()) {
+        origin = i;
+      }
+    }
+    const Vec3f originPos = nodes.pos[origin];
+
+    // nodes are missing near the border of the slice, where the grid ends,
+    // which would hide translations. nodes are moved by at most twice the
+    // search radius, which keeps them within three quarters of the distance
+    // to the bounds
+    float inner = std::numeric_limits<float>::max();
+    for (int i = 0; i < sliceDim; ++i) {
+      inner = std::min(inner, std::min(originPos[i] - pickMin[i],
+                                       pickMax[i] - originPos[i]));
+    }
+    float maxRadius = 0.75f * inner / 2.f;
+
+    float spacing = std::numeric_limits<float>::max();
+    for (unsigned int e = nodes.neighbourOffsets[origin];
+         e < nodes.neighbourOffsets[origin + 1]; ++e) {
+      spacing = std::min(spacing, nodes.neighbourVecs[e].mag());
+    }
+    if (spacing == std::numeric_limits<float>::max()) {
+      spacing = 1.f;
+    }
+
+    // nodes within radius, closest first, so differences are tried from the
+    // shortest and a wrong one usually fails on the first few nodes
+    std::vector<unsigned int> near;
+    auto nodesNear = [&](float radius) {
+      near.clear();
+      pickHash.forEachNear(originPos, radius, [&](unsigned int id) {
+        if (id != origin && (nodes.pos[id] - originPos).mag() <= radius) {
+          near.push_back(id);
+        }
+      });
+      std::sort(near.begin(), near.end(),
+                [&](unsigned int a, unsigned int b) {
+                  float magA = (nodes.pos[a] - originPos).magSqr();
+                  float magB = (nodes.pos[b] - originPos).magSqr();
+                  return magA < magB || (magA == magB && a < b);
+                });
+    };
+
+    // a translation moves the origin onto a node with the same neighbours,
+    // and a difference that failed once fails for every larger radius, as
+    // the nodes it failed on are still tested
+    std::vector<uint8_t> isRejected(nodes.size(), 0);
+    for (unsigned int id = 0; id < nodes.size(); ++id) {
+      isRejected[id] = !nodes.compareNeighbours(origin, id);
+    }
+
+    unsigned int lookups = 0;
+    std::vector<Vec3f> basis;
+    for (float radius = std::min(1.5f * spacing, maxRadius);
+         basis.size() < (unsigned int)sliceDim && lookups <= maxLookups;
+         radius = std::min(2.f * radius, maxRadius)) {
+      // the differences to the nodes within radius are tested on the same
+      // nodes, so every node they are moved onto is within the trusted part
+      nodesNear(radius);
+
+      // shortest linearly independent translations. differences that
+      // depend on the ones already taken cannot add to them and are skipped
+      // without being tested
+      basis.clear();
+      std::vector<Vec3f> orthonormal;
+      for (unsigned int id : near) {
+        if (isRejected[id]) {
+          continue;
+        }
+
+        Vec3f diff = nodes.pos[id] - originPos;
+        Vec3f rest = diff;
+        for (auto &u : orthonormal) {
+          rest -= rest.dot(u) * u;
+        }
+        if (rest.mag() <= 1E-3 * diff.mag()) {
+          continue;
+        }
+
+        for (unsigned int i : near) {
+          if (++lookups > maxLookups || findNode(nodes.pos[i] + diff) < 0) {
+            isRejected[id] = 1;
+            break;
+          }
+        }
+        if (lookups > maxLookups) {
+          break;
+        }
+
+        if (!isRejected[id]) {
+          basis.push_back(diff);
+          orthonormal.push_back(rest.normalized());
+          if (basis.size() == (unsigned int)sliceDim) {
+            break;
+          }
+        }
+      }
+
+      if (radius == maxRadius) {
+        break;
+      }
+    }
+
+    if (lookups > maxLookups) {
+      std::cout << "Unable to find unit cell: No translations within "
+                << maxLookups << " node lookups" << std::endl;
+      return false;
+    }
+
+    if (basis.size() < (unsigned int)sliceDim) {
+      std::cout << "Unable to find unit cell: No translations within "
+                << maxRadius << " of the centre" << std::endl;
+      return false;
+    }
+
+    lllReduce(basis);
+    niggliReduce(basis);
+
+    corners.push_back(origin);
+    for (auto &b : basis) {
+      int corner = findNode(originPos + b);
+      if (corner < 0) {
+        std::cout << "Unable to find unit cell: Missing corner node"
+                  << std::endl;
+        corners.clear();
+        return false;
+      }
+      corners.push_back(corner);
+    }
+
+    return true;
+  }
+
   // TODO: confine this to unit cell
   virtual void exportToTxt(std::string &filePath) {
+    waitForResult();
+
     filePath += ".txt";
     std::ofstream txtOut(filePath);
 
@@ -673,19 +2696,36 @@ template <int N, int M> struct Slice : AbstractSlice {
       txtOut << std::to_string(basis[M - 1]) << std::endl;
     }
 
-    for (auto &v : projectedVertices) {
+    for (auto &v : nodes.pos) {
       // for (auto &v : planeVertices) {
-      for (int i = 0; i < N - 1; ++i) {
-        txtOut << std::to_string(v[i]) + " ";
-      }
-      txtOut << std::to_string(v[N - 1]) << std::endl;
+      txtOut << std::to_string(v[0]) + " " + std::to_string(v[1]) + " " +
+                    std::to_string(v[2])
+             << std::endl;
     }
 
     std::cout << "Exported to txt: " << filePath << std::endl;
   }
 
   virtual void exportToJson(std::string &filePath) {
+    waitForResult();
+
     filePath += ".json";
+    json newJson = toJson();
+
+    std::ofstream jsonOut(filePath);
+    if (!jsonOut.good()) {
+      std::cerr << "Unable to export to : " << filePath << std::endl;
+      return;
+    }
+
+    jsonOut << std::setw(2) << newJson;
+
+    std::cout << "Exported to json: " << filePath << std::endl;
+  }
+
+  // bases, miller indices and unit cell of the current result, as exported.
+  // the caller makes sure the worker is idle
+  json toJson() {
     json newJson;
 
     for (auto &b : lattice->basis) {
@@ -704,11 +2744,18 @@ template <int N, int M> struct Slice : AbstractSlice {
       newJson["unitCell_basis"].push_back(basis);
     }
 
-    for (auto *node : unitCell.unitCellNodes) {
-      newJson["unitCell_positions"].push_back(node->pos);
-      if (node->isInteriorNode) {
+    for (unsigned int node : unitCell.unitCellNodes) {
+      newJson["unitCell_positions"].push_back(nodes.pos[node]);
+
+      std::vector<int> latticeCoord(N);
+      for (int d = 0; d < N; ++d) {
+        latticeCoord[d] = nodes.latticeCoord.get(node, d);
+      }
+      newJson["unitCell_lattice_coords"].push_back(latticeCoord);
+
+      if (nodes.flags[node] & interiorNode) {
         newJson["unitCell_interior_fract_coords"].push_back(
-            node->unitCellCoord);
+            nodes.unitCellCoord[node]);
       }
     }
 
@@ -716,15 +2763,7 @@ template <int N, int M> struct Slice : AbstractSlice {
     //   newJson["vertices"].push_back(v);
     // }
 
-    std::ofstream jsonOut(filePath);
-    if (!jsonOut.good()) {
-      std::cerr << "Unable to export to : " << filePath << std::endl;
-      return;
-    }
-
-    jsonOut << std::setw(2) << newJson;
-
-    std::cout << "Exported to json: " << filePath << std::endl;
+    return newJson;
   }
 };
 
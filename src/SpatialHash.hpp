@@ -0,0 +1,214 @@
+#ifndef SPATIAL_HASH_HPP
+#define SPATIAL_HASH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "al/math/al_Vec.hpp"
+
+using namespace al;
+
+static const unsigned int noEntry = UINT32_MAX;
+
+// slab test of the ray origin + t * dir against an axis aligned box. tEnter
+// and tLeave are limited to the part of the ray in front of the origin
+inline bool intersectRayBox(const Vec3f &origin, const Vec3f &dir,
+                            const Vec3f &boxMin, const Vec3f &boxMax,
+                            float &tEnter, float &tLeave) {
+  tEnter = 0.f;
+  tLeave = std::numeric_limits<float>::infinity();
+
+  for (int i = 0; i < 3; ++i) {
+    if (dir[i] == 0.f) {
+      if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+        return false;
+      }
+      continue;
+    }
+
+    float t0 = (boxMin[i] - origin[i]) / dir[i];
+    float t1 = (boxMax[i] - origin[i]) / dir[i];
+    tEnter = std::max(tEnter, std::min(t0, t1));
+    tLeave = std::min(tLeave, std::max(t0, t1));
+    if (tEnter > tLeave) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// uniform grid of cubic cells over 3D positions, stored sparsely in a hash
+// map. every cell keeps a singly linked list of the ids inserted into it, ids
+// are expected to be small and dense (node indices)
+struct SpatialHash {
+  float cellSize;
+  std::unordered_map<uint64_t, unsigned int> firstEntry;
+  std::vector<unsigned int> nextEntry;
+
+  SpatialHash(float newCellSize = 1.f) : cellSize(newCellSize) {}
+
+  void clear(float newCellSize) {
+    cellSize = newCellSize;
+    clear();
+  }
+
+  void clear() {
+    firstEntry.clear();
+    nextEntry.clear();
+  }
+
+  void reserve(size_t size) {
+    firstEntry.reserve(size);
+    nextEntry.reserve(size);
+  }
+
+  // approximate, the nodes and buckets of the map depend on the library
+  size_t bytes() const {
+    return firstEntry.size() *
+               (sizeof(std::pair<const uint64_t, unsigned int>) +
+                sizeof(void *)) +
+           firstEntry.bucket_count() * sizeof(void *) +
+           nextEntry.size() * sizeof(unsigned int);
+  }
+
+  int cellCoord(float value) const { return (int)std::floor(value / cellSize); }
+
+  // packs 21 bits per axis. cells far enough apart to alias only share a
+  // bucket, callers always check the actual distance
+  static uint64_t key(int x, int y, int z) {
+    return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) |
+           (uint64_t)(z & 0x1FFFFF);
+  }
+
+  void insert(const Vec3f &pos, unsigned int id) {
+    if (id >= nextEntry.size()) {
+      nextEntry.resize(id + 1, noEntry);
+    }
+
+    uint64_t cellKey =
+        key(cellCoord(pos[0]), cellCoord(pos[1]), cellCoord(pos[2]));
+
+    auto it = firstEntry.find(cellKey);
+    if (it == firstEntry.end()) {
+      nextEntry[id] = noEntry;
+      firstEntry[cellKey] = id;
+    } else {
+      nextEntry[id] = it->second;
+      it->second = id;
+    }
+  }
+
+  // renumbers every entry to newIds[id], entries mapped to noEntry are dropped
+  void remap(const std::vector<unsigned int> &newIds) {
+    std::vector<unsigned int> newNextEntry(nextEntry.size(), noEntry);
+
+    for (auto it = firstEntry.begin(); it != firstEntry.end();) {
+      unsigned int head = noEntry;
+      unsigned int tail = noEntry;
+
+      for (unsigned int id = it->second; id != noEntry; id = nextEntry[id]) {
+        unsigned int newId = newIds[id];
+        if (newId == noEntry) {
+          continue;
+        }
+
+        if (head == noEntry) {
+          head = newId;
+        } else {
+          newNextEntry[tail] = newId;
+        }
+        tail = newId;
+      }
+
+      if (head == noEntry) {
+        it = firstEntry.erase(it);
+      } else {
+        it->second = head;
+        ++it;
+      }
+    }
+
+    nextEntry.swap(newNextEntry);
+  }
+
+  // calls func(id) for every id in cell (x, y, z)
+  template <typename F> void forEachInCell(int x, int y, int z, F func) const {
+    auto it = firstEntry.find(key(x, y, z));
+    if (it == firstEntry.end()) {
+      return;
+    }
+
+    for (unsigned int id = it->second; id != noEntry; id = nextEntry[id]) {
+      func(id);
+    }
+  }
+
+  // calls func(id) for every id in the cells overlapping the axis aligned box
+  // of half size radius around pos
+  template <typename F>
+  void forEachNear(const Vec3f &pos, float radius, F func) const {
+    int minX = cellCoord(pos[0] - radius), maxX = cellCoord(pos[0] + radius);
+    int minY = cellCoord(pos[1] - radius), maxY = cellCoord(pos[1] + radius);
+    int minZ = cellCoord(pos[2] - radius), maxZ = cellCoord(pos[2] + radius);
+
+    for (int x = minX; x <= maxX; ++x) {
+      for (int y = minY; y <= maxY; ++y) {
+        for (int z = minZ; z <= maxZ; ++z) {
+          forEachInCell(x, y, z, func);
+        }
+      }
+    }
+  }
+
+  // walks the cells the ray origin + t * dir passes through for t between
+  // tMin and tMax, in order along the ray, and calls func(x, y, z, tExit)
+  // with tExit where the ray leaves the cell. stops when func returns false
+  template <typename F>
+  void forEachCellOnRay(const Vec3f &origin, const Vec3f &dir, float tMin,
+                        float tMax, F func) const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    Vec3f start = origin + dir * tMin;
+
+    int cell[3];
+    int step[3];
+    float tNext[3];
+    float tDelta[3];
+    for (int i = 0; i < 3; ++i) {
+      cell[i] = cellCoord(start[i]);
+
+      if (dir[i] > 0.f) {
+        step[i] = 1;
+        tNext[i] = tMin + ((cell[i] + 1) * cellSize - start[i]) / dir[i];
+        tDelta[i] = cellSize / dir[i];
+      } else if (dir[i] < 0.f) {
+        step[i] = -1;
+        tNext[i] = tMin + (cell[i] * cellSize - start[i]) / dir[i];
+        tDelta[i] = -cellSize / dir[i];
+      } else {
+        step[i] = 0;
+        tNext[i] = infinity;
+        tDelta[i] = infinity;
+      }
+    }
+
+    while (true) {
+      int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2)
+                                     : (tNext[1] < tNext[2] ? 1 : 2);
+      float tExit = std::min(tNext[axis], tMax);
+
+      if (!func(cell[0], cell[1], cell[2], tExit) || tExit >= tMax) {
+        return;
+      }
+
+      cell[axis] += step[axis];
+      tNext[axis] += tDelta[axis];
+    }
+  }
+};
+
+#endif // SPATIAL_HASH_HPP
\ No newline at end of file
@@ -0,0 +1,170 @@
+#ifndef SUBLATTICE_HPP
+#define SUBLATTICE_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+// integer points on rational hyperplanes. K integer vectors a_k cut Z^N into
+// layers of equal a_k . c, and every layer is a copy of the rank N - K
+// lattice of the points with a_k . c = 0
+
+// floor and ceiling of a / b for b != 0
+inline int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+inline int64_t ceilDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && (a < 0) == (b < 0)) ? q + 1 : q;
+}
+
+// returns g = gcd(a, b) >= 0 and x, y with a * x + b * y = g
+inline int64_t extendedGcd(int64_t a, int64_t b, int64_t &x, int64_t &y) {
+  int64_t oldR = a, r = b;
+  int64_t oldX = 1, newX = 0;
+  int64_t oldY = 0, newY = 1;
+  while (r != 0) {
+    int64_t q = oldR / r;
+    oldR -= q * r;
+    std::swap(oldR, r);
+    oldX -= q * newX;
+    std::swap(oldX, newX);
+    oldY -= q * newY;
+    std::swap(oldY, newY);
+  }
+  if (oldR < 0) {
+    oldR = -oldR;
+    oldX = -oldX;
+    oldY = -oldY;
+  }
+  x = oldX;
+  y = oldY;
+  return oldR;
+}
+
+// column hermite normal form of the K x N matrix rows. finds a unimodular
+// U with rows * U = [H 0], where H is K x K lower triangular with a positive
+// diagonal and 0 <= H[k][j] < H[k][k] below it. columns[j] is column j of
+// U: the last N - K columns are a basis of the integer points with
+// rows * c = 0, and column k < K moves a point by column k of H. returns
+// false if the rows are linearly dependent
+template <int N, int K>
+bool hermiteNormalForm(std::array<std::array<int64_t, N>, K> rows,
+                       std::array<std::array<int64_t, K>, K> &hermite,
+                       std::array<std::array<int64_t, N>, N> &columns) {
+  for (int j = 0; j < N; ++j) {
+    columns[j].fill(0);
+    columns[j][j] = 1;
+  }
+
+  // applies the unimodular column operation
+  // (col a, col b) <- (col a, col b) * [[p, r], [q, s]]
+  auto combine = [&](int a, int b, int64_t p, int64_t q, int64_t r,
+                     int64_t s) {
+    for (auto &row : rows) {
+      int64_t va = row[a], vb = row[b];
+      row[a] = p * va + q * vb;
+      row[b] = r * va + s * vb;
+    }
+    for (int d = 0; d < N; ++d) {
+      int64_t va = columns[a][d], vb = columns[b][d];
+      columns[a][d] = p * va + q * vb;
+      columns[b][d] = r * va + s * vb;
+    }
+  };
+
+  for (int k = 0; k < K; ++k) {
+    // gathers the gcd of row k from column k on into column k
+    for (int j = k + 1; j < N; ++j) {
+      int64_t a = rows[k][k], b = rows[k][j];
+      if (b == 0) {
+        continue;
+      }
+      int64_t x, y;
+      int64_t g = extendedGcd(a, b, x, y);
+      combine(k, j, x, y, -b / g, a / g);
+    }
+
+    if (rows[k][k] == 0) {
+      return false;
+    }
+    if (rows[k][k] < 0) {
+      for (auto &row : rows) {
+        row[k] = -row[k];
+      }
+      for (int d = 0; d < N; ++d) {
+        columns[k][d] = -columns[k][d];
+      }
+    }
+
+    for (int j = 0; j < k; ++j) {
+      int64_t q = floorDiv(rows[k][j], rows[k][k]);
+      if (q != 0) {
+        // col j -= q * col k
+        for (auto &row : rows) {
+          row[j] -= q * row[k];
+        }
+        for (int d = 0; d < N; ++d) {
+          columns[j][d] -= q * columns[k][d];
+        }
+      }
+    }
+  }
+
+  for (int k = 0; k < K; ++k) {
+    for (int j = 0; j < K; ++j) {
+      hermite[k][j] = rows[k][j];
+    }
+  }
+  return true;
+}
+
+// inverts matrix in place by gauss-jordan elimination. returns false if it
+// is singular
+template <int M>
+bool invertMatrix(std::array<std::array<double, M>, M> &matrix) {
+  std::array<std::array<double, M>, M> inverse;
+  for (int i = 0; i < M; ++i) {
+    inverse[i].fill(0.0);
+    inverse[i][i] = 1.0;
+  }
+
+  for (int i = 0; i < M; ++i) {
+    int pivot = i;
+    for (int j = i + 1; j < M; ++j) {
+      if (std::abs(matrix[j][i]) > std::abs(matrix[pivot][i])) {
+        pivot = j;
+      }
+    }
+    if (std::abs(matrix[pivot][i]) < 1E-12) {
+      return false;
+    }
+    std::swap(matrix[i], matrix[pivot]);
+    std::swap(inverse[i], inverse[pivot]);
+
+    double scale = 1.0 / matrix[i][i];
+    for (int j = 0; j < M; ++j) {
+      matrix[i][j] *= scale;
+      inverse[i][j] *= scale;
+    }
+    for (int j = 0; j < M; ++j) {
+      if (j == i) {
+        continue;
+      }
+      double factor = matrix[j][i];
+      for (int l = 0; l < M; ++l) {
+        matrix[j][l] -= factor * matrix[i][l];
+        inverse[j][l] -= factor * inverse[i][l];
+      }
+    }
+  }
+
+  matrix = inverse;
+  return true;
+}
+
+#endif // SUBLATTICE_HPP
\ No newline at end of file
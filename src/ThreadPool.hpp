@@ -0,0 +1,161 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// persistent worker threads shared by lattice and slice computations
+struct ThreadPool {
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex queueLock;
+  std::condition_variable queueCondition;
+  bool stopping{false};
+
+  ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency()) {
+    if (numThreads == 0) {
+      numThreads = 1;
+    }
+
+    for (unsigned int i = 0; i < numThreads; ++i) {
+      workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(queueLock);
+      stopping = true;
+    }
+    queueCondition.notify_all();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  static ThreadPool &global() { return *globalPool(); }
+
+  // replaces the shared pool, e.g. to measure thread scaling. only safe while
+  // nothing is running on it
+  static void setGlobalSize(unsigned int numThreads) {
+    globalPool().reset(new ThreadPool(numThreads));
+  }
+
+  unsigned int size() { return (unsigned int)workers.size(); }
+
+  void enqueue(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(queueLock);
+      tasks.push(std::move(task));
+    }
+    queueCondition.notify_one();
+  }
+
+  // runs one queued task on the calling thread, returns false if none waiting
+  bool runPending() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(queueLock);
+      if (tasks.empty()) {
+        return false;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+    return true;
+  }
+
+  // splits [begin, end) into contiguous index ranges and calls
+  // func(rangeIdx, rangeBegin, rangeEnd) for each of them on the workers.
+  // blocks until all ranges are done. the calling thread works on queued
+  // tasks while waiting, so nested calls from inside a worker cannot deadlock
+  template <typename F>
+  void parallelFor(size_t begin, size_t end, F func, size_t numRanges = 0) {
+    if (end <= begin) {
+      return;
+    }
+
+    if (numRanges == 0) {
+      numRanges = size();
+    }
+    numRanges = std::min(numRanges, end - begin);
+
+    if (numRanges <= 1) {
+      func(0, begin, end);
+      return;
+    }
+
+    size_t rangeSize = (end - begin) / numRanges;
+    size_t remainder = (end - begin) % numRanges;
+
+    size_t remaining = numRanges;
+    std::mutex doneLock;
+    std::condition_variable doneCondition;
+
+    auto runRange = [&](size_t rangeIdx) {
+      size_t rangeBegin =
+          begin + rangeIdx * rangeSize + std::min(rangeIdx, remainder);
+      size_t rangeEnd = rangeBegin + rangeSize + (rangeIdx < remainder ? 1 : 0);
+
+      func(rangeIdx, rangeBegin, rangeEnd);
+
+      std::lock_guard<std::mutex> lock(doneLock);
+      remaining--;
+      doneCondition.notify_all();
+    };
+
+    for (size_t i = 1; i < numRanges; ++i) {
+      enqueue([&runRange, i]() { runRange(i); });
+    }
+
+    runRange(0);
+
+    while (true) {
+      if (runPending()) {
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(doneLock);
+      if (doneCondition.wait_for(lock, std::chrono::milliseconds(1),
+                                 [&]() { return remaining == 0; })) {
+        break;
+      }
+    }
+  }
+
+private:
+  static std::unique_ptr<ThreadPool> &globalPool() {
+    static std::unique_ptr<ThreadPool> pool(new ThreadPool());
+    return pool;
+  }
+
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(queueLock);
+        queueCondition.wait(lock,
+                            [this]() { return stopping || !tasks.empty(); });
+
+        if (stopping && tasks.empty()) {
+          return;
+        }
+
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      task();
+    }
+  }
+};
+
+#endif // THREAD_POOL_HPP
\ No newline at end of file
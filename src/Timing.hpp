@@ -0,0 +1,113 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <vector>
+
+// stages of a slice computation, timed on the worker thread
+enum SliceStage : unsigned int {
+  normalsStage,
+  enumerationStage,
+  overlapStage,
+  updateNodesStage,
+  environmentStage,
+  renderDataStage,
+  pickHashStage,
+  // looking up, restoring and storing full results in the result cache
+  cacheStage,
+  stageNum
+};
+
+static const std::array<const char *, stageNum> stageNames{
+    {"computeNormals", "enumeration", "overlapScan", "updateNodes",
+     "environments", "renderData", "pickHash", "resultCache"}};
+
+// wall time per stage and element counts of one computation
+struct SliceStats {
+  std::array<float, stageNum> stageMs{};
+  unsigned int candidates{0};
+  unsigned int nodes{0};
+  unsigned int pairs{0};
+  unsigned int edges{0};
+  unsigned int environments{0};
+
+  float totalMs() const {
+    float total = 0.f;
+    for (float ms : stageMs) {
+      total += ms;
+    }
+    return total;
+  }
+};
+
+// adds the milliseconds between construction and destruction, or an earlier
+// stop(), to target
+struct ScopedTimer {
+  float &target;
+  std::chrono::steady_clock::time_point start;
+  bool running{true};
+
+  ScopedTimer(float &newTarget)
+      : target(newTarget), start(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() { stop(); }
+
+  void stop() {
+    if (running) {
+      target += std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+      running = false;
+    }
+  }
+};
+
+// the last few hundred frame times, for percentiles
+struct FrameTimes {
+  std::vector<float> samples;
+  size_t next{0};
+  std::chrono::steady_clock::time_point lastFrame;
+  bool started{false};
+  // duration of the latest frame, zero before the second call to frame
+  float lastMs{0.f};
+
+  FrameTimes(size_t size = 300) { samples.reserve(size); }
+
+  // records the time since the previous call
+  void frame() {
+    auto now = std::chrono::steady_clock::now();
+    if (started) {
+      lastMs =
+          std::chrono::duration<float, std::milli>(now - lastFrame).count();
+      add(lastMs);
+    }
+    lastFrame = now;
+    started = true;
+  }
+
+  void add(float ms) {
+    if (samples.size() < samples.capacity()) {
+      samples.push_back(ms);
+    } else {
+      samples[next] = ms;
+      next = (next + 1) % samples.size();
+    }
+  }
+
+  // nearest rank percentile, p between 0 and 100
+  float percentile(float p) const {
+    if (samples.empty()) {
+      return 0.f;
+    }
+
+    std::vector<float> sorted(samples);
+    size_t rank =
+        std::min(sorted.size() - 1, size_t(p / 100.f * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+  }
+};
+
+#endif // TIMING_HPP
\ No newline at end of file
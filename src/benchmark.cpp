@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Dimensions.hpp"
+#include "Lattice.hpp"
+#include "Slice.hpp"
+#include "ThreadPool.hpp"
+
+using namespace al;
+
+// runs the lattice and slice computations without a window and prints the
+// timings as json, so runs can be compared between commits.
+//
+// usage: crystal-benchmark [--dims 3:2,4:3] [--sizes 4,8] [--depths 0.5,1]
+//                          [--thresholds 1.1,1.5] [--threads 1,4]
+//                          [--repeats 3] [--out file.json]
+
+struct BenchmarkOptions {
+  std::vector<std::pair<int, int>> dims{{3, 2}, {4, 2}, {4, 3}, {5, 2}, {5, 3}};
+  std::vector<int> sizes{4, 8};
+  std::vector<float> depths{0.5f, 1.f};
+  std::vector<float> thresholds{1.1f, 1.5f};
+  std::vector<int> threads{1, (int)std::thread::hardware_concurrency()};
+  int repeats{3};
+  std::string outPath;
+};
+
+// peak resident set size of the process in kilobytes, -1 if unknown
+long peakRssKb() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return long(counters.PeakWorkingSetSize / 1024);
+  }
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+#ifdef __APPLE__
+  return long(usage.ru_maxrss / 1024);
+#else
+  return long(usage.ru_maxrss);
+#endif
+#endif
+}
+
+template <typename F> double timeMs(F func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+json stageStats(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  return {{"min", samples.front()}, {"median", samples[samples.size() / 2]}};
+}
+
+// one lattice and slice per repeat. stages:
+//   lattice: Lattice::update
+//   slice: full Slice::update on the worker, including updateNodes, and
+//          slice.<stage> for the stages it times itself
+//   updateNodes: updateNodes alone on the same nodes
+//   depth: incremental update for a 10% deeper slice
+//   threshold: incremental update for a 10% lower edge threshold
+template <int N, int M>
+json runCase(int size, float depth, float threshold, int repeats) {
+  std::map<std::string, std::vector<double>> samples;
+  json result;
+
+  for (int r = 0; r < repeats; ++r) {
+    auto lattice = std::make_shared<Lattice<N>>(nullptr);
+    lattice->latticeSize = size;
+    samples["lattice"].push_back(timeMs([&]() { lattice->update(); }));
+
+    Slice<N, M> slice(nullptr, lattice);
+    slice.millerIndices[0] = Vec<N, float>(1.f);
+    slice.sliceDepth = depth;
+    slice.edgeThreshold = threshold;
+    slice.maxEdgeThreshold = std::max(slice.maxEdgeThreshold, threshold);
+
+    samples["slice"].push_back(timeMs([&]() {
+      slice.needsUpdate = true;
+      slice.pollUpdate();
+      slice.waitForResult();
+    }));
+
+    // breakdown of the full update by the slice's own stage timers
+    SliceStats stats = slice.getStats();
+    for (unsigned int i = 0; i < stageNum; ++i) {
+      samples[std::string("slice.") + stageNames[i]].push_back(
+          stats.stageMs[i]);
+    }
+
+    result["nodes"] = slice.getVertexNum();
+    result["edges"] = slice.getEdgeNum();
+    result["environments"] = slice.environments.size();
+
+    // the worker is idle after waitForResult, so its state may be used here
+    samples["updateNodes"].push_back(timeMs([&]() { slice.updateNodes(); }));
+
+    samples["depth"].push_back(timeMs([&]() {
+      slice.setDepth(depth * 1.1f);
+      slice.pollUpdate();
+      slice.waitForResult();
+    }));
+
+    samples["threshold"].push_back(timeMs([&]() {
+      slice.setThreshold(threshold * 0.9f);
+      slice.pollUpdate();
+      slice.waitForResult();
+    }));
+  }
+
+  for (auto &stage : samples) {
+    result["stagesMs"][stage.first] = stageStats(stage.second);
+  }
+  result["peakRssKb"] = peakRssKb();
+
+  return result;
+}
+
+template <int N, int M>
+void runSweep(const BenchmarkOptions &options, json &runs) {
+  for (int size : options.sizes) {
+    for (float depth : options.depths) {
+      for (float threshold : options.thresholds) {
+        for (int threadNum : options.threads) {
+          ThreadPool::setGlobalSize(threadNum);
+
+          json run = runCase<N, M>(size, depth, threshold, options.repeats);
+          run["latticeDim"] = N;
+          run["sliceDim"] = M;
+          run["latticeSize"] = size;
+          run["sliceDepth"] = depth;
+          run["edgeThreshold"] = threshold;
+          run["threads"] = threadNum;
+          runs.push_back(run);
+
+          std::cerr << "N" << N << " M" << M << " size " << size << " depth "
+                    << depth << " threshold " << threshold << " threads "
+                    << threadNum << ": "
+                    << run["stagesMs"]["slice"]["median"].get<double>()
+                    << " ms" << std::endl;
+        }
+      }
+    }
+  }
+}
+
+template <typename T> std::vector<T> parseList(const std::string &text) {
+  std::vector<T> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    std::stringstream itemStream(item);
+    T value;
+    if (itemStream >> value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+bool parseOptions(int argc, char *argv[], BenchmarkOptions &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Error: missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--dims") {
+      options.dims.clear();
+      for (auto &pair : parseList<std::string>(value)) {
+        size_t colon = pair.find(':');
+        if (colon == std::string::npos) {
+          std::cerr << "Error: dims are given as N:M, not " << pair
+                    << std::endl;
+          return false;
+        }
+        options.dims.push_back({std::stoi(pair.substr(0, colon)),
+                                std::stoi(pair.substr(colon + 1))});
+      }
+    } else if (arg == "--sizes") {
+      options.sizes = parseList<int>(value);
+    } else if (arg == "--depths") {
+      options.depths = parseList<float>(value);
+    } else if (arg == "--thresholds") {
+      options.thresholds = parseList<float>(value);
+    } else if (arg == "--threads") {
+      options.threads = parseList<int>(value);
+    } else if (arg == "--repeats") {
+      options.repeats = std::max(1, std::stoi(value));
+    } else if (arg == "--out") {
+      options.outPath = value;
+    } else {
+      std::cerr << "Error: unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 1;
+  }
+
+  json runs = json::array();
+  for (auto &dims : options.dims) {
+    int n = dims.first;
+    int m = dims.second;
+
+    bool supported = dispatchDimensions(n, m, [&](auto dims) {
+      typedef decltype(dims) D;
+      runSweep<D::latticeDim, D::sliceDim>(options, runs);
+    });
+    if (!supported) {
+      std::cerr << "Error: dimension " << n << ":" << m << " not supported"
+                << std::endl;
+    }
+  }
+
+  json report;
+  report["hardwareThreads"] = std::thread::hardware_concurrency();
+  report["repeats"] = options.repeats;
+  report["peakRssKb"] = peakRssKb();
+  report["runs"] = runs;
+
+  if (options.outPath.empty()) {
+    std::cout << report.dump(2) << std::endl;
+  } else {
+    std::ofstream file(options.outPath);
+    if (!file.is_open()) {
+      std::cerr << "Error: unable to open " << options.outPath << std::endl;
+      return 1;
+    }
+    file << report.dump(2) << std::endl;
+  }
+
+  return 0;
+}
\ No newline at end of file
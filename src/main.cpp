@@ -67,16 +67,14 @@ struct CrystalApp : DistributedAppWithState<State> {
 
   bool onMouseMove(const Mouse &m) override {
     if (!ImGui::IsAnyWindowHovered()) {
-      viewer.slice->pickableManager.onMouseMove(graphics(), m, width(),
-                                                height());
+      viewer.slice->onMouseMove(graphics(), m, width(), height());
     }
     return true;
   }
 
   bool onMouseDown(const Mouse &m) override {
     if (!ImGui::IsAnyWindowHovered()) {
-      viewer.slice->pickableManager.onMouseDown(graphics(), m, width(),
-                                                height());
+      viewer.slice->onMouseDown(graphics(), m, width(), height());
       viewer.updatePickables(m.right());
     }
     return true;
@@ -89,7 +87,7 @@ struct CrystalApp : DistributedAppWithState<State> {
   }*/
 
   bool onMouseUp(const Mouse &m) override {
-    viewer.slice->pickableManager.onMouseUp(graphics(), m, width(), height());
+    viewer.slice->onMouseUp(graphics(), m, width(), height());
     return true;
   }
 
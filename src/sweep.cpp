@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Dimensions.hpp"
+#include "Lattice.hpp"
+#include "Slice.hpp"
+#include "ThreadPool.hpp"
+
+using namespace al;
+
+// evaluates a grid of slice parameters without a window and writes the
+// results of every configuration to one json file.
+//
+// usage: crystal-sweep spec.json [out.json]
+//
+// spec:
+// {
+//   "latticeDim": 4, "sliceDim": 3, "latticeSize": 6,
+//   "bases": [[[1, 0, 0, 0], ...]],         lattice bases, default identity
+//   "millerIndices": [[[1, 1, 0, 0]], ...], explicit sets of N - M indices
+//   "millerRanges": [{"min": [0, 0, 0, 0], "max": [1, 1, 1, 1]}, ...],
+//                                           integer grid per miller index
+//   "sliceDepths": [0.5, 1.0],
+//   "edgeThresholds": [1.1, 1.5],
+//   "acceptanceWindow": "sphere",           or "hypercube"
+//   "threads": 4                            slices computed at a time
+// }
+//
+// millerIndices and millerRanges are combined. a set of miller indices is
+// computed once at the largest depth and threshold, every other depth and
+// threshold is an incremental update of the same candidates and node pairs
+
+template <int N> bool readVec(const json &value, Vec<N, float> &vec) {
+  if (!value.is_array() || value.size() != N) {
+    std::cerr << "Error: expected a vector of size " << N << ", got "
+              << value.dump() << std::endl;
+    return false;
+  }
+  for (int i = 0; i < N; ++i) {
+    vec[i] = value[i].get<float>();
+  }
+  return true;
+}
+
+// one lattice basis and one set of miller indices, evaluated by one slice
+template <int N, int M> struct SweepGroup {
+  unsigned int basisIdx;
+  std::array<Vec<N, float>, N - M> millerIndices;
+};
+
+// every integer vector between min and max, componentwise
+template <int N>
+std::vector<Vec<N, float>> expandRange(const Vec<N, float> &low,
+                                       const Vec<N, float> &high) {
+  std::vector<Vec<N, float>> vectors;
+  Vec<N, float> vec = low;
+
+  while (true) {
+    if (vec.mag() > 0.f) {
+      vectors.push_back(vec);
+    }
+
+    int i = 0;
+    for (; i < N; ++i) {
+      vec[i] += 1.f;
+      if (vec[i] <= high[i]) {
+        break;
+      }
+      vec[i] = low[i];
+    }
+    if (i == N) {
+      return vectors;
+    }
+  }
+}
+
+template <int N, int M>
+bool readMillerSets(const json &spec,
+                    std::vector<std::array<Vec<N, float>, N - M>> &sets) {
+  if (spec.contains("millerIndices")) {
+    for (auto &entry : spec["millerIndices"]) {
+      std::array<Vec<N, float>, N - M> set;
+      if (entry.size() != N - M) {
+        std::cerr << "Error: a set of miller indices needs " << N - M
+                  << " vectors" << std::endl;
+        return false;
+      }
+      for (int i = 0; i < N - M; ++i) {
+        if (!readVec<N>(entry[i], set[i])) {
+          return false;
+        }
+      }
+      sets.push_back(set);
+    }
+  }
+
+  if (spec.contains("millerRanges")) {
+    const json &ranges = spec["millerRanges"];
+    if (ranges.size() > N - M) {
+      std::cerr << "Error: at most " << N - M << " miller ranges" << std::endl;
+      return false;
+    }
+
+    // indices without a range keep their default unit vector
+    std::array<std::vector<Vec<N, float>>, N - M> choices;
+    for (int i = 0; i < N - M; ++i) {
+      if (i < (int)ranges.size()) {
+        Vec<N, float> low, high;
+        if (!readVec<N>(ranges[i]["min"], low) ||
+            !readVec<N>(ranges[i]["max"], high)) {
+          return false;
+        }
+        choices[i] = expandRange<N>(low, high);
+      } else {
+        Vec<N, float> unit(0.f);
+        unit[i] = 1.f;
+        choices[i].push_back(unit);
+      }
+      if (choices[i].empty()) {
+        std::cerr << "Error: miller range " << i << " has no nonzero vector"
+                  << std::endl;
+        return false;
+      }
+    }
+
+    std::array<size_t, N - M> choice{};
+    while (true) {
+      std::array<Vec<N, float>, N - M> set;
+      for (int i = 0; i < N - M; ++i) {
+        set[i] = choices[i][choice[i]];
+      }
+      sets.push_back(set);
+
+      int i = 0;
+      for (; i < N - M; ++i) {
+        if (++choice[i] < choices[i].size()) {
+          break;
+        }
+        choice[i] = 0;
+      }
+      if (i == N - M) {
+        break;
+      }
+    }
+  }
+
+  if (sets.empty()) {
+    std::array<Vec<N, float>, N - M> set;
+    for (int i = 0; i < N - M; ++i) {
+      set[i] = 0.f;
+      set[i][i] = 1.f;
+    }
+    sets.push_back(set);
+  }
+
+  return true;
+}
+
+// node count of every environment, largest first, so results can be
+// compared even though environment ids depend on the node order
+template <int N, int M> json environmentHistogram(Slice<N, M> &slice) {
+  std::vector<unsigned int> counts(slice.environments.size(), 0);
+  for (unsigned int i = 0; i < slice.nodes.size(); ++i) {
+    counts[slice.nodes.environment[i]]++;
+  }
+  std::sort(counts.begin(), counts.end(), std::greater<unsigned int>());
+  return counts;
+}
+
+template <int N, int M>
+void runGroup(const SweepGroup<N, M> &group, Lattice<N> &lattice,
+              AcceptanceWindow window, std::vector<float> depths,
+              std::vector<float> thresholds, std::vector<json> &results) {
+  // largest depth first so the candidates enumerated for it cover the rest
+  std::sort(depths.begin(), depths.end(), std::greater<float>());
+  std::sort(thresholds.begin(), thresholds.end());
+
+  // the slice keeps a raw pointer, the lattice is shared by all groups
+  std::shared_ptr<Lattice<N>> latticePtr(&lattice, [](Lattice<N> *) {});
+  Slice<N, M> slice(nullptr, latticePtr);
+  slice.millerIndices = group.millerIndices;
+  slice.window = window;
+  slice.sliceDepth = depths.front();
+  slice.edgeThreshold = thresholds.front();
+  slice.maxEdgeThreshold = thresholds.back();
+
+  slice.needsUpdate = true;
+  slice.pollUpdate();
+  slice.waitForResult();
+
+  for (float depth : depths) {
+    if (depth != slice.sliceDepth) {
+      slice.setDepth(depth);
+    }
+
+    for (float threshold : thresholds) {
+      if (threshold != slice.edgeThreshold) {
+        slice.setThreshold(threshold);
+      }
+      slice.pollUpdate();
+      slice.waitForResult();
+
+      json result;
+      result["basis"] = group.basisIdx;
+      for (auto &millerIndex : group.millerIndices) {
+        result["millerIndices"].push_back(millerIndex);
+      }
+      result["sliceDepth"] = depth;
+      result["edgeThreshold"] = threshold;
+      result["nodes"] = slice.getVertexNum();
+      result["edges"] = slice.getEdgeNum();
+      result["environments"] = slice.environments.size();
+      result["environmentHistogram"] = environmentHistogram(slice);
+      result["slice"] = slice.toJson();
+      results.push_back(result);
+    }
+  }
+}
+
+template <int N, int M> bool runSweep(const json &spec, json &report) {
+  int latticeSize = spec.value("latticeSize", 4);
+
+  std::vector<std::array<Vec<N, float>, N>> bases;
+  if (spec.contains("bases")) {
+    for (auto &entry : spec["bases"]) {
+      std::array<Vec<N, float>, N> basis;
+      if (entry.size() != N) {
+        std::cerr << "Error: a lattice basis needs " << N << " vectors"
+                  << std::endl;
+        return false;
+      }
+      for (int i = 0; i < N; ++i) {
+        if (!readVec<N>(entry[i], basis[i])) {
+          return false;
+        }
+      }
+      bases.push_back(basis);
+    }
+  }
+
+  std::vector<std::array<Vec<N, float>, N - M>> millerSets;
+  if (!readMillerSets<N, M>(spec, millerSets)) {
+    return false;
+  }
+
+  std::vector<float> depths =
+      spec.value("sliceDepths", std::vector<float>{1.f});
+  std::vector<float> thresholds =
+      spec.value("edgeThresholds", std::vector<float>{1.1f});
+  if (depths.empty() || thresholds.empty()) {
+    std::cerr << "Error: sliceDepths and edgeThresholds must not be empty"
+              << std::endl;
+    return false;
+  }
+
+  std::string windowName = spec.value("acceptanceWindow", "sphere");
+  auto windowIt =
+      std::find(windowNames.begin(), windowNames.end(), windowName);
+  if (windowIt == windowNames.end()) {
+    std::cerr << "Error: unknown acceptance window " << windowName
+              << std::endl;
+    return false;
+  }
+  AcceptanceWindow window = AcceptanceWindow(windowIt - windowNames.begin());
+
+  // the lattice grid is only bounds and a basis, it is built once per basis
+  // and read by every slice
+  std::vector<std::unique_ptr<Lattice<N>>> lattices;
+  if (bases.empty()) {
+    lattices.emplace_back(new Lattice<N>(nullptr));
+  }
+  for (auto &basis : bases) {
+    lattices.emplace_back(new Lattice<N>(nullptr));
+    lattices.back()->basis = basis;
+  }
+  for (auto &lattice : lattices) {
+    lattice->latticeSize = latticeSize;
+    lattice->update();
+  }
+
+  std::vector<SweepGroup<N, M>> groups;
+  for (unsigned int b = 0; b < lattices.size(); ++b) {
+    for (auto &millerSet : millerSets) {
+      groups.push_back({b, millerSet});
+    }
+  }
+
+  // each slice already spreads its work over the thread pool, running a few
+  // of them at once keeps the cores busy through the serial parts
+  unsigned int threadNum =
+      spec.value("threads", std::thread::hardware_concurrency());
+  threadNum = std::max(1u, std::min(threadNum, (unsigned int)groups.size()));
+
+  std::vector<std::vector<json>> groupResults(groups.size());
+  std::atomic<unsigned int> nextGroup{0};
+  std::atomic<unsigned int> doneGroups{0};
+
+  auto sweepWorker = [&]() {
+    for (unsigned int g = nextGroup++; g < groups.size(); g = nextGroup++) {
+      runGroup<N, M>(groups[g], *lattices[groups[g].basisIdx], window,
+                     depths, thresholds, groupResults[g]);
+      std::cerr << "group " << ++doneGroups << "/" << groups.size() << " done"
+                << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < threadNum; ++i) {
+    threads.emplace_back(sweepWorker);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  report["latticeDim"] = N;
+  report["sliceDim"] = M;
+  report["latticeSize"] = latticeSize;
+  report["acceptanceWindow"] = windowName;
+  for (auto &lattice : lattices) {
+    json basis;
+    for (auto &b : lattice->basis) {
+      basis.push_back(b);
+    }
+    report["bases"].push_back(basis);
+  }
+  report["configurations"] = json::array();
+  for (auto &results : groupResults) {
+    for (auto &result : results) {
+      report["configurations"].push_back(result);
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: crystal-sweep spec.json [out.json]" << std::endl;
+    return 1;
+  }
+
+  std::ifstream specFile(argv[1]);
+  if (!specFile.is_open()) {
+    std::cerr << "Error: unable to open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  json spec;
+  try {
+    specFile >> spec;
+  } catch (json::exception &e) {
+    std::cerr << "Error: unable to parse " << argv[1] << ": " << e.what()
+              << std::endl;
+    return 1;
+  }
+
+  int n = spec.value("latticeDim", 3);
+  int m = spec.value("sliceDim", 2);
+
+  json report;
+  bool success = false;
+  try {
+    bool supported = dispatchDimensions(n, m, [&](auto dims) {
+      typedef decltype(dims) D;
+      success = runSweep<D::latticeDim, D::sliceDim>(spec, report);
+    });
+    if (!supported) {
+      std::cerr << "Error: dimension " << n << ":" << m << " not supported"
+                << std::endl;
+    }
+  } catch (json::exception &e) {
+    std::cerr << "Error: invalid sweep spec: " << e.what() << std::endl;
+  }
+
+  if (!success) {
+    return 1;
+  }
+
+  if (argc < 3) {
+    std::cout << report.dump(2) << std::endl;
+  } else {
+    std::ofstream file(argv[2]);
+    if (!file.is_open()) {
+      std::cerr << "Error: unable to open " << argv[2] << std::endl;
+      return 1;
+    }
+    file << report.dump(2) << std::endl;
+  }
+
+  return 0;
+}
\ No newline at end of file
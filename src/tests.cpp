@@ -0,0 +1,771 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "Lattice.hpp"
+#include "Pathway.hpp"
+#include "SlabKernel.hpp"
+#include "Slice.hpp"
+
+using namespace al;
+
+// headless checks of the lattice and slice computations, registered with
+// ctest one test per name.
+//
+// usage: crystal-tests [name]...
+// runs the named tests, or all of them, and exits with 1 if any fails
+
+// prints what went wrong for a failed check
+bool check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "Error: " << what << std::endl;
+  }
+  return condition;
+}
+
+template <typename F> double timeMs(F func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// runs a full update of slice and waits for it, so the render thread side
+// may use the nodes afterwards
+template <int N, int M> void computeSlice(Slice<N, M> &slice) {
+  slice.lattice->update();
+  slice.needsUpdate = true;
+  slice.pollUpdate();
+  slice.waitForResult();
+}
+
+bool sameColor(const Color &a, const Color &b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// box instances of the hovered and selected nodes and the unit cell corners
+// against those with every node boxed, and the time it takes to build them
+bool testBoxInstances() {
+  auto lattice = std::make_shared<Lattice<3>>(nullptr);
+  lattice->latticeSize = 16;
+  Slice<3, 2> slice(nullptr, lattice);
+  slice.millerIndices[0] = Vec3f(1.f, 1.f, 1.f);
+  computeSlice(slice);
+
+  bool passed = true;
+  unsigned int nodeNum = slice.nodes.size();
+  if (!check(nodeNum > 10, "too few nodes for the box test")) {
+    return false;
+  }
+
+  const Color selectedColor(0.f, 1.f, 1.f);
+  const Color hoverColor(1.f, 1.f, 1.f);
+  const Color cornerColor(1.f, 1.f, 0.f);
+  const Color allColor(1.f, 1.f, 1.f, 0.3f);
+
+  slice.selectedNode = 3;
+  slice.hoverNode = 7;
+  slice.updateBoxInstances(false);
+  passed &= check(slice.boxPositions.size() == 2 &&
+                      slice.boxColors.size() == 2,
+                  "hovered and selected node should give two boxes");
+  if (passed) {
+    passed &= check(slice.boxPositions[0] == slice.nodes.pos[3] &&
+                        sameColor(slice.boxColors[0], selectedColor),
+                    "first box should be the selected node");
+    passed &= check(slice.boxPositions[1] == slice.nodes.pos[7] &&
+                        sameColor(slice.boxColors[1], hoverColor),
+                    "second box should be the hovered node");
+  }
+
+  // a hovered node that is selected is only boxed once
+  slice.hoverNode = 3;
+  slice.updateBoxInstances(false);
+  passed &= check(slice.boxPositions.size() == 1,
+                  "hovering the selected node should give one box");
+
+  slice.hoverNode = -1;
+  slice.selectedNode = -1;
+  slice.unitCell.cornerNodes = {0, 1, 2};
+  slice.updateBoxInstances(false);
+  passed &= check(slice.boxPositions.size() == 3,
+                  "every unit cell corner should be boxed");
+  for (unsigned int i = 0; i < slice.boxPositions.size(); ++i) {
+    passed &= check(slice.boxPositions[i] == slice.nodes.pos[i] &&
+                        sameColor(slice.boxColors[i], cornerColor),
+                    "corner box " + std::to_string(i) + " is wrong");
+  }
+  slice.unitCell.cornerNodes.clear();
+
+  slice.selectedNode = 3;
+  slice.hoverNode = 7;
+  slice.updateBoxInstances(true);
+  passed &= check(slice.boxPositions.size() == nodeNum + 2 &&
+                      slice.boxColors.size() == nodeNum + 2,
+                  "show all boxes should box every node and then the "
+                  "hovered and selected ones");
+  if (passed) {
+    for (unsigned int i = 0; i < nodeNum; ++i) {
+      if (!check(slice.boxPositions[i] == slice.nodes.pos[i] &&
+                     sameColor(slice.boxColors[i], allColor),
+                 "box of node " + std::to_string(i) + " is wrong")) {
+        passed = false;
+        break;
+      }
+    }
+    passed &= check(slice.boxPositions[nodeNum] == slice.nodes.pos[3] &&
+                        slice.boxPositions[nodeNum + 1] == slice.nodes.pos[7],
+                    "hovered and selected boxes should follow all boxes");
+  }
+
+  const int repeats = 100;
+  double selectedMs = timeMs([&]() {
+    for (int r = 0; r < repeats; ++r) {
+      slice.updateBoxInstances(false);
+    }
+  });
+  double allMs = timeMs([&]() {
+    for (int r = 0; r < repeats; ++r) {
+      slice.updateBoxInstances(true);
+    }
+  });
+  std::cerr << "box instances for " << nodeNum << " nodes: "
+            << selectedMs / repeats << " ms selected, " << allMs / repeats
+            << " ms all" << std::endl;
+
+  return passed;
+}
+
+// the simd slab kernels against the scalar one on random runs. they may
+// only disagree about points within rounding of the slab boundary
+template <int K> bool compareSlabKernels(std::mt19937 &random) {
+  std::uniform_real_distribution<float> value(-3.f, 3.f);
+  std::vector<int> scalarHits(256), simdHits(256);
+  bool passed = true;
+
+  for (int run = 0; run < 2000; ++run) {
+    float base[K], step[K];
+    for (int k = 0; k < K; ++k) {
+      base[k] = value(random);
+      step[k] = 0.1f * value(random);
+    }
+    float depthSq = 1.f + 0.3f * value(random);
+    int low = -100, high = 100;
+
+    auto normSq = [&](int x) {
+      float sum = 0.f;
+      for (int k = 0; k < K; ++k) {
+        float offset = base[k] + float(x) * step[k];
+        sum += offset * offset;
+      }
+      return sum;
+    };
+    auto compare = [&](int scalarNum, int simdNum, const char *name) {
+      std::vector<int> difference;
+      std::set_symmetric_difference(
+          scalarHits.begin(), scalarHits.begin() + scalarNum, simdHits.begin(),
+          simdHits.begin() + simdNum, std::back_inserter(difference));
+      for (int x : difference) {
+        if (!check(std::abs(normSq(x) - depthSq) < 1E-4f * depthSq,
+                   std::string(name) + " kernel disagrees at x = " +
+                       std::to_string(x) + " for K = " + std::to_string(K))) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    int scalarNum = slabRunScalar<K>(base, step, low, high, depthSq,
+                                     scalarHits.data());
+#ifdef SLAB_KERNEL_X86
+    int sseNum =
+        slabRunSse<K>(base, step, low, high, depthSq, simdHits.data());
+    passed &= compare(scalarNum, sseNum, "sse");
+    if (simdLevel() == SimdLevel::avx) {
+      int avxNum =
+          slabRunAvx<K>(base, step, low, high, depthSq, simdHits.data());
+      passed &= compare(scalarNum, avxNum, "avx");
+    }
+#endif
+    int hitNum = slabRun<K>(base, step, low, high, depthSq, simdHits.data());
+    passed &= compare(scalarNum, hitNum, "dispatched");
+    if (!passed) {
+      return false;
+    }
+  }
+  return passed;
+}
+
+bool testSlabKernels() {
+  std::mt19937 random(1);
+  return compareSlabKernels<1>(random) && compareSlabKernels<2>(random) &&
+         compareSlabKernels<3>(random) && compareSlabKernels<5>(random);
+}
+
+// the lattice coordinates of the candidates with their offsets from the
+// hyperplanes and their positions. false if a point is there twice
+template <int N, int M>
+bool candidateSet(
+    const Slice<N, M> &slice,
+    std::map<std::vector<int>, typename Slice<N, M>::SliceCandidate> &set) {
+  set.clear();
+  for (unsigned int c = 0; c < slice.candidates.size(); ++c) {
+    std::vector<int> coord(N);
+    for (int d = 0; d < N; ++d) {
+      coord[d] = slice.candidateCoords.get(c, d);
+    }
+    set[coord] = slice.candidates[c];
+  }
+  return set.size() == slice.candidates.size();
+}
+
+// the candidates of the enumeration the slice ran last against a scan of
+// the whole grid in double precision. points within rounding of the slab
+// boundary may be on either side
+template <int N, int M>
+bool compareCandidates(const Slice<N, M> &slice, const std::string &name) {
+  typedef typename Slice<N, M>::SliceCandidate Candidate;
+  std::map<std::vector<int>, Candidate> set;
+  if (!check(candidateSet(slice, set), name + ": duplicate candidates")) {
+    return false;
+  }
+
+  auto &params = slice.params;
+  float depth = slice.candidateDepth;
+  float tolerance = 1E-4f * std::max(1.f, depth);
+  unsigned int found = 0;
+  std::vector<int> point(N, params.minCoord);
+
+  while (true) {
+    Vec<N - M, float> perp;
+    Vec3f pos(0.f);
+    for (int j = 0; j < N; ++j) {
+      double value = 0.0;
+      for (int d = 0; d < N; ++d) {
+        value += double(point[d]) * slice.projectionRows[d][j];
+      }
+      if (j < N - M) {
+        perp[j] = float(value);
+      } else {
+        pos[j - (N - M)] = float(value);
+      }
+    }
+    float norm = slice.windowNorm(perp);
+
+    auto it = set.find(point);
+    if (it == set.end()) {
+      if (!check(norm >= depth - tolerance,
+                 name + ": a point within the slab is missing")) {
+        return false;
+      }
+    } else {
+      ++found;
+      if (!check(norm < depth + tolerance,
+                 name + ": a point outside the slab is a candidate") ||
+          !check((it->second.perp - perp).mag() < 1E-3f &&
+                     (it->second.pos - pos).mag() < 1E-3f,
+                 name + ": a candidate has wrong offsets or position")) {
+        return false;
+      }
+    }
+
+    int d = 0;
+    while (d < N && point[d] == params.maxCoord) {
+      point[d] = params.minCoord;
+      ++d;
+    }
+    if (d == N) {
+      break;
+    }
+    point[d]++;
+  }
+
+  return check(found == set.size(),
+               name + ": candidates outside the lattice grid");
+}
+
+// nodes and edges of the slice against merging the accepted candidates and
+// connecting them pair by pair. a full update accepts the candidates in
+// order, so the node ids have to match as well
+template <int N, int M>
+bool compareNodes(const Slice<N, M> &slice, const std::string &name) {
+  auto &params = slice.params;
+  std::vector<Vec3f> positions;
+  std::vector<unsigned int> overlaps;
+
+  for (auto &candidate : slice.candidates) {
+    if (slice.windowNorm(candidate.perp - params.sliceOffset) >=
+        params.sliceDepth) {
+      continue;
+    }
+    int match = -1;
+    for (unsigned int i = 0; i < positions.size() && match < 0; ++i) {
+      if ((candidate.pos - positions[i]).sumAbs() < compareThreshold) {
+        match = i;
+      }
+    }
+    if (match >= 0) {
+      overlaps[match]++;
+    } else {
+      positions.push_back(candidate.pos);
+      overlaps.push_back(0);
+    }
+  }
+
+  if (!check(positions.size() == slice.nodes.size(),
+             name + ": " + std::to_string(slice.nodes.size()) +
+                 " nodes instead of " + std::to_string(positions.size()))) {
+    return false;
+  }
+
+  std::vector<unsigned int> neighbourNums(positions.size(), 0);
+  unsigned int edgeNum = 0;
+  for (unsigned int i = 0; i < positions.size(); ++i) {
+    if (!check(positions[i] == slice.nodes.pos[i] &&
+                   overlaps[i] == slice.nodes.overlap[i],
+               name + ": node " + std::to_string(i) + " differs")) {
+      return false;
+    }
+    for (unsigned int j = i + 1; j < positions.size(); ++j) {
+      if ((positions[i] - positions[j]).mag() < params.edgeThreshold) {
+        neighbourNums[i]++;
+        neighbourNums[j]++;
+        edgeNum++;
+      }
+    }
+  }
+
+  bool passed = check(edgeNum == slice.activePairs &&
+                          edgeNum == slice.edgeStarts.size(),
+                      name + ": " + std::to_string(slice.activePairs) +
+                          " edges instead of " + std::to_string(edgeNum));
+  for (unsigned int i = 0; i < positions.size() && passed; ++i) {
+    passed &= check(neighbourNums[i] == slice.nodes.neighbourNum(i),
+                    name + ": node " + std::to_string(i) +
+                        " has the wrong neighbours");
+  }
+  return passed;
+}
+
+// node positions in a fixed order and the edge count, to compare results
+// whose node ids differ
+template <int N, int M>
+std::pair<std::vector<Vec3f>, unsigned int>
+sortedNodes(const Slice<N, M> &slice) {
+  std::vector<Vec3f> positions = slice.nodes.pos;
+  std::sort(positions.begin(), positions.end(),
+            [](const Vec3f &a, const Vec3f &b) {
+              return std::make_tuple(a[0], a[1], a[2]) <
+                     std::make_tuple(b[0], b[1], b[2]);
+            });
+  return {positions, slice.activePairs};
+}
+
+// one slice checked through every enumeration that applies to it, against
+// the reference scans, and its incremental depth update against a full
+// update at the new depth
+template <int N, int M>
+bool checkSlice(const std::string &name, int latticeSize,
+                const std::vector<Vec<N, float>> &millers,
+                AcceptanceWindow window, float depth, bool periodic) {
+  auto lattice = std::make_shared<Lattice<N>>(nullptr);
+  lattice->latticeSize = latticeSize;
+  Slice<N, M> slice(nullptr, lattice);
+  for (int k = 0; k < N - M; ++k) {
+    slice.millerIndices[k] = millers[k];
+  }
+  slice.window = window;
+  slice.sliceDepth = depth;
+  computeSlice(slice);
+
+  // the slice is idle, so its enumerations can be rerun here
+  bool passed = compareNodes(slice, name);
+  passed &= compareCandidates(slice, name);
+
+  if (window == hypercubeWindow) {
+    slice.template enumerateSlab<Slice<N, M>::maxWindowFacets,
+                                 Slice<N, M>::maxWindowFacets + N>(
+        slice.windowRows, true);
+  } else {
+    slice.template enumerateSlab<N - M, N>(slice.projectionRows, false);
+  }
+  passed &= compareCandidates(slice, name + " slab");
+  // the nodes came from the enumeration a full update picks, which has to
+  // give the ids of the grid order as well
+  passed &= compareNodes(slice, name + " grid order");
+
+  bool isPeriodic = slice.enumerateSublattice();
+  passed &= check(isPeriodic == periodic,
+                  name + (periodic ? ": not enumerated as periodic"
+                                   : ": enumerated as periodic"));
+  if (isPeriodic) {
+    passed &= compareCandidates(slice, name + " sublattice");
+    passed &= compareNodes(slice, name + " sublattice");
+  }
+
+  Slice<N, M> deeper(nullptr, lattice);
+  for (int k = 0; k < N - M; ++k) {
+    deeper.millerIndices[k] = millers[k];
+  }
+  deeper.window = window;
+  deeper.sliceDepth = 1.2f * depth;
+  computeSlice(deeper);
+
+  computeSlice(slice);
+  slice.setDepth(1.2f * depth);
+  slice.pollUpdate();
+  slice.waitForResult();
+  passed &= check(sortedNodes(slice) == sortedNodes(deeper),
+                  name + ": incremental depth update differs");
+
+  std::cerr << name << ": " << slice.candidates.size() << " candidates, "
+            << slice.nodes.size() << " nodes" << std::endl;
+  return passed;
+}
+
+// a vector of N floats from a list, for dimensions without a constructor
+template <int N> Vec<N, float> vecOf(std::initializer_list<float> values) {
+  Vec<N, float> vec(0.f);
+  int d = 0;
+  for (float value : values) {
+    vec[d++] = value;
+  }
+  return vec;
+}
+
+bool testEnumeration() {
+  float phi = 0.5f * (1.f + std::sqrt(5.f));
+  bool passed = true;
+
+  passed &= checkSlice<3, 2>("3:2 periodic", 8, {Vec3f(1.f, 2.f, 3.f)},
+                             sphereWindow, 0.8f, true);
+  passed &= checkSlice<3, 2>("3:2 (1,1,0)", 8, {Vec3f(1.f, 1.f, 0.f)},
+                             sphereWindow, 0.8f, true);
+  passed &= checkSlice<3, 2>("3:2", 8, {Vec3f(1.f, phi, 0.3f)}, sphereWindow,
+                             0.8f, false);
+  passed &= checkSlice<4, 3>("4:3 periodic", 6, {Vec4f(1.f, 1.f, 0.f, 0.f)},
+                             sphereWindow, 0.5f, true);
+  passed &= checkSlice<4, 3>("4:3", 6, {Vec4f(1.f, phi, 0.3f, 0.2f)},
+                             sphereWindow, 0.5f, false);
+  passed &= checkSlice<4, 3>("4:3 hypercube", 6,
+                             {Vec4f(1.f, phi, 0.3f, 0.2f)}, hypercubeWindow,
+                             0.5f, false);
+  passed &= checkSlice<4, 2>(
+      "4:2 periodic", 5,
+      {Vec4f(1.f, 1.f, 0.f, 0.f), Vec4f(0.f, 0.f, 1.f, -1.f)}, sphereWindow,
+      0.8f, true);
+
+  // penrose tiling
+  std::vector<Vec<5, float>> penrose(3);
+  for (int d = 0; d < 5; ++d) {
+    float angle = 2.f * 3.14159265f * d / 5.f;
+    penrose[0][d] = std::cos(angle);
+    penrose[1][d] = std::sin(angle);
+    penrose[2][d] = 1.f;
+  }
+  passed &= checkSlice<5, 2>("5:2 hypercube", 3, penrose, hypercubeWindow,
+                             1.f, false);
+  passed &= checkSlice<5, 2>("5:2 periodic", 3,
+                             {vecOf<5>({1.f, 1.f, 0.f, 0.f, 0.f}),
+                              vecOf<5>({0.f, 0.f, 1.f, -1.f, 0.f}),
+                              vecOf<5>({0.f, 1.f, 0.f, 1.f, 1.f})},
+                             hypercubeWindow, 1.f, true);
+  passed &= checkSlice<5, 3>("5:3 periodic", 3,
+                             {vecOf<5>({1.f, 0.f, 1.f, 0.f, 0.f}),
+                              vecOf<5>({0.f, 1.f, 0.f, -1.f, 1.f})},
+                             sphereWindow, 0.8f, true);
+
+  std::vector<Vec<6, float>> millers6(3);
+  for (int k = 0; k < 3; ++k) {
+    for (int d = 0; d < 6; ++d) {
+      millers6[k][d] = std::sin((k + 1) * 1.3f * d + 0.4f * k + 0.2f);
+    }
+  }
+  passed &= checkSlice<6, 3>("6:3 hypercube", 4, millers6, hypercubeWindow,
+                             0.8f, false);
+
+  return passed;
+}
+
+// the unit cell the worker finds in a periodic slice, and that an aperiodic
+// slice gives none. the slab across the cubic lattice holds all three
+// stacked (1,1,1) layers, which project onto a triangular lattice with a
+// third of the area of a face diagonal cell
+bool testUnitCell() {
+  bool passed = true;
+
+  auto lattice = std::make_shared<Lattice<3>>(nullptr);
+  lattice->latticeSize = 16;
+  Slice<3, 2> slice(nullptr, lattice);
+  slice.millerIndices[0] = Vec3f(1.f, 1.f, 1.f);
+  computeSlice(slice);
+
+  double periodicMs = timeMs([&]() {
+    slice.findUnitCell();
+    slice.waitForResult();
+  });
+  passed &= check(slice.unitCell.cornerNodes.size() == 3 &&
+                      slice.unitCell.unitBasis.size() == 2,
+                  "periodic slice should give a unit cell");
+  for (auto &basis : slice.unitCell.unitBasis) {
+    passed &= check(std::abs(basis.mag() - std::sqrt(2.f / 3.f)) < 1E-3f,
+                    "unit cell vector of length " +
+                        std::to_string(basis.mag()) +
+                        " should be sqrt(2 / 3)");
+  }
+
+  // a new result drops the unit cell of the previous nodes
+  slice.needsThresholdUpdate = true;
+  slice.pollUpdate();
+  slice.waitForResult();
+  passed &= check(slice.unitCell.cornerNodes.empty(),
+                  "unit cell should be cleared by a new result");
+
+  float phi = 0.5f * (1.f + std::sqrt(5.f));
+  auto aperiodicLattice = std::make_shared<Lattice<3>>(nullptr);
+  aperiodicLattice->latticeSize = 16;
+  Slice<3, 2> aperiodic(nullptr, aperiodicLattice);
+  aperiodic.millerIndices[0] = Vec3f(1.f, phi, 0.3f);
+  computeSlice(aperiodic);
+
+  double aperiodicMs = timeMs([&]() {
+    aperiodic.findUnitCell();
+    aperiodic.waitForResult();
+  });
+  passed &= check(aperiodic.unitCell.cornerNodes.empty(),
+                  "aperiodic slice should not give a unit cell");
+
+  std::cerr << "unit cell for " << slice.nodes.size() << " nodes: "
+            << periodicMs << " ms periodic, " << aperiodicMs
+            << " ms aperiodic for " << aperiodic.nodes.size() << " nodes"
+            << std::endl;
+  return passed;
+}
+
+// the pathway playhead waits for the first frame and then moves in real
+// time whether or not the frames at it are ready
+bool testPathwayPlayback() {
+  auto lattice = std::make_shared<Lattice<3>>(nullptr);
+  std::shared_ptr<AbstractSlice> slice =
+      std::make_shared<Slice<3, 2>>(nullptr, lattice);
+
+  Pathway pathway;
+  PathwayKeyframe keyframe;
+  for (int i = 0; i < 3; ++i) {
+    keyframe.basis[i] = LatticeVec(0.f);
+    keyframe.basis[i][i] = 1.f;
+  }
+  keyframe.miller[0] = LatticeVec(0.f);
+  keyframe.miller[0][0] = 1.f;
+  keyframe.miller[0][1] = 1.f;
+  keyframe.miller[0][2] = 1.f;
+  pathway.addKeyframe(keyframe);
+  keyframe.time = 1.f;
+  keyframe.sliceDepth = 2.f;
+  pathway.addKeyframe(keyframe);
+
+  PathwayPlayer player;
+  if (!check(player.start(pathway, slice, 8), "pathway should start")) {
+    return false;
+  }
+
+  bool passed = true;
+  std::shared_ptr<const SliceFrame> frame;
+  double firstMs = timeMs([&]() {
+    for (int i = 0; i < 10000 && !frame; ++i) {
+      frame = player.advance(0.1f);
+      if (!frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+  passed &= check(frame != nullptr, "no frame within ten seconds");
+  passed &= check(player.time() == 0.f,
+                  "playhead should wait for the first frame");
+
+  // a loop is 61 frames long, so these steps never wrap around
+  const float dt = 0.2f;
+  for (int i = 1; i <= 4; ++i) {
+    frame = player.advance(dt);
+    passed &= check(frame != nullptr, "a frame should stay shown");
+    passed &= check(std::abs(player.time() - i * dt) < 1E-5f,
+                    "playhead at " + std::to_string(player.time()) +
+                        " should be at " + std::to_string(i * dt));
+  }
+  player.stop();
+
+  std::cerr << "first pathway frame after " << firstMs << " ms" << std::endl;
+  return passed;
+}
+
+// result cache keys are equal for equal parameters, whatever the sign of
+// their zeros, and differ for different ones
+bool testResultKey() {
+  auto lattice = std::make_shared<Lattice<3>>(nullptr);
+  lattice->latticeSize = 8;
+  Slice<3, 2> slice(nullptr, lattice);
+  slice.millerIndices[0] = Vec3f(1.f, 2.f, 3.f);
+  computeSlice(slice);
+
+  bool passed = true;
+  auto &params = slice.params;
+  params.sliceOffset[0] = 0.f;
+  std::string key = slice.resultKey();
+
+  params.sliceOffset[0] = -0.f;
+  passed &= check(slice.resultKey() == key, "-0 should give the same key");
+
+  params.millerIndices[0][0] = -params.millerIndices[0][0];
+  passed &= check(slice.resultKey() != key,
+                  "other miller indices should give another key");
+  params.millerIndices[0][0] = -params.millerIndices[0][0];
+
+  params.sliceDepth += 0.1f;
+  passed &= check(slice.resultKey() != key,
+                  "another depth should give another key");
+  params.sliceDepth -= 0.1f;
+
+  params.window = hypercubeWindow;
+  passed &= check(slice.resultKey() != key,
+                  "another window should give another key");
+  return passed;
+}
+
+// a result restored from the cache matches the computed one, and a depth
+// update or a unit cell search on it works as on a computed one
+bool testResultCache() {
+  auto lattice = std::make_shared<Lattice<3>>(nullptr);
+  lattice->latticeSize = 12;
+  Slice<3, 2> slice(nullptr, lattice);
+  slice.resultCache = std::make_shared<ResultCache>(size_t(64) * 1000000);
+
+  auto computeFor = [&](const Vec3f &miller) {
+    slice.millerIndices[0] = miller;
+    computeSlice(slice);
+  };
+
+  bool passed = true;
+  computeFor(Vec3f(1.f, 1.f, 1.f));
+  auto computed = sortedNodes(slice);
+  computeFor(Vec3f(1.f, 2.f, 3.f));
+  computeFor(Vec3f(1.f, 1.f, 1.f));
+  passed &= check(slice.resultCache->getStats().hits == 1,
+                  "the first slice should be restored from the cache");
+  passed &= check(sortedNodes(slice) == computed,
+                  "restored nodes differ from the computed ones");
+
+  slice.findUnitCell();
+  slice.waitForResult();
+  passed &= check(slice.unitCell.cornerNodes.size() == 3,
+                  "restored slice should give a unit cell");
+
+  // on its own lattice, as an update of the shared one would make the next
+  // update of slice a full one
+  auto deeperLattice = std::make_shared<Lattice<3>>(nullptr);
+  deeperLattice->latticeSize = 12;
+  Slice<3, 2> deeper(nullptr, deeperLattice);
+  deeper.millerIndices[0] = Vec3f(1.f, 1.f, 1.f);
+  deeper.sliceDepth = 1.2f * slice.sliceDepth;
+  computeSlice(deeper);
+
+  slice.setDepth(1.2f * slice.sliceDepth);
+  slice.pollUpdate();
+  slice.waitForResult();
+  passed &= check(sortedNodes(slice) == sortedNodes(deeper),
+                  "depth update of a restored slice differs");
+  return passed;
+}
+
+// nodes whose neighbours match within compareThreshold on either side of an
+// environment key cell boundary are found under each other's keys
+bool testEnvironmentKeys() {
+  float boundary = 0.f;
+  while (NodeStore::environmentCell(boundary) ==
+         NodeStore::environmentCell(0.f)) {
+    boundary += 1E-6f;
+  }
+
+  NodeStore nodes;
+  PackedCoords coords;
+  coords.reset(3, 0, 1);
+  coords.push(Vec<3, int>(0));
+  // the second node's neighbours are shifted, the first across the boundary
+  std::vector<Vec3f> vecs{
+      Vec3f(boundary - 0.4f * compareThreshold, 0.5f, 0.f),
+      Vec3f(-1.f, 0.25f, 0.125f)};
+  Vec3f shift(0.8f * compareThreshold, 0.f, 0.f);
+  for (int n = 0; n < 2; ++n) {
+    nodes.add(Vec3f(float(n), 0.f, 0.f), coords, 0);
+    for (const Vec3f &vec : vecs) {
+      nodes.neighbourIds.push_back(0);
+      nodes.neighbourVecs.push_back(n == 0 ? vec : vec + shift);
+    }
+    nodes.neighbourOffsets.back() = nodes.neighbourVecs.size();
+  }
+
+  bool passed = true;
+  passed &= check(nodes.compareNeighbours(0, 1),
+                  "nodes should have the same environment");
+  passed &= check(nodes.environmentKey(0) != nodes.environmentKey(1),
+                  "neighbours should be on either side of a cell boundary");
+  for (unsigned int n = 0; n < 2; ++n) {
+    bool found = false;
+    nodes.forEachEnvironmentKey(n, 8, [&](uint64_t key) {
+      found |= key == nodes.environmentKey(1 - n);
+    });
+    passed &= check(found, "key of node " + std::to_string(1 - n) +
+                               " should be among those of node " +
+                               std::to_string(n));
+  }
+  return passed;
+}
+
+struct Test {
+  const char *name;
+  bool (*run)();
+};
+
+int main(int argc, char *argv[]) {
+  std::vector<Test> tests{{"boxInstances", testBoxInstances},
+                          {"slabKernels", testSlabKernels},
+                          {"enumeration", testEnumeration},
+                          {"unitCell", testUnitCell},
+                          {"pathwayPlayback", testPathwayPlayback},
+                          {"resultKey", testResultKey},
+                          {"resultCache", testResultCache},
+                          {"environmentKeys", testEnvironmentKeys}};
+
+  std::vector<std::string> names(argv + 1, argv + argc);
+  for (auto &name : names) {
+    bool known = false;
+    for (auto &test : tests) {
+      known |= name == test.name;
+    }
+    if (!known) {
+      std::cerr << "Error: unknown test " << name << std::endl;
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  for (auto &test : tests) {
+    if (!names.empty() &&
+        std::find(names.begin(), names.end(), test.name) == names.end()) {
+      continue;
+    }
+    bool passed = test.run();
+    std::cerr << (passed ? "passed " : "FAILED ") << test.name << std::endl;
+    failed += !passed;
+  }
+
+  return failed > 0 ? 1 : 0;
+}
\ No newline at end of file